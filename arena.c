@@ -0,0 +1,76 @@
+#include "arena.h"
+
+#include "stdio.h"
+#include "assert.h"
+
+arena arena_empty(){
+  arena a;
+  a.first = NULL;
+  a.block = NULL;
+  a.used  = 0;
+  a.size  = 0;
+  a.stats.peak = 0;
+  a.stats.allocations = a.stats.releases = 0;
+  a.stats.blocks   = 0;
+  a.stats.capacity = 0;
+  return a;
+}
+
+void arena_free(arena* a){
+  assert(a != NULL);
+  arena_block* b = a->first;
+  while(b != NULL){
+    arena_block* next = b->next;
+    free(b);
+    b = next;
+  }
+  *a = arena_empty();
+}
+
+// Block following the current one with room for bytes, a new one is inserted there if needed
+arena_block* arena_next_block(arena* a, size_t bytes){
+  arena_block* next = a->block != NULL ? a->block->next : a->first;
+  if(next != NULL && next->capacity >= bytes){
+    return next;
+  }
+  // Total capacity doubles with each new block
+  size_t capacity = a->stats.capacity > ARENA_BLOCK_MIN ? a->stats.capacity : ARENA_BLOCK_MIN;
+  if(capacity < bytes){
+    capacity = bytes;
+  }
+  arena_block* b = malloc(sizeof(arena_block) + capacity);
+  if(b == NULL){
+    fprintf(stderr, "arena : out of memory\n");
+    abort();
+  }
+  b->next     = next;
+  b->capacity = capacity;
+  if(a->block != NULL){
+    a->block->next = b;
+  }else{
+    a->first = b;
+  }
+  a->stats.blocks   += 1;
+  a->stats.capacity += capacity;
+  return b;
+}
+
+void* arena_alloc(arena* a, size_t bytes){
+  assert(a != NULL);
+  bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+  if(a->block == NULL || a->used + bytes > a->block->capacity){
+    if(a->block != NULL){
+      a->size += a->block->capacity - a->used;
+    }
+    a->block = arena_next_block(a, bytes);
+    a->used  = 0;
+  }
+  void* p = a->block->data + a->used;
+  a->used += bytes;
+  a->size += bytes;
+  if(a->size > a->stats.peak){
+    a->stats.peak = a->size;
+  }
+  a->stats.allocations += 1;
+  return p;
+}
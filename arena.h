@@ -0,0 +1,65 @@
+#ifndef ALGO_GISO_ARENA_H
+#define ALGO_GISO_ARENA_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+
+/*
+ * arena
+ *
+ * Region allocator : allocations are taken in order from a list of blocks and never freed one by one.
+ * arena_release frees everything allocated since a mark in O(1), the blocks being kept for the next allocations.
+ * Blocks are only freed by arena_free. Allocations are aligned on ARENA_ALIGN bytes
+ */
+
+#define ARENA_ALIGN      16
+#define ARENA_BLOCK_MIN  (64 * 1024)
+
+typedef struct arena_block {
+  struct arena_block* next;
+  size_t              capacity;
+  unsigned char       data[]; // at offset 16, aligned as the block
+} arena_block;
+
+typedef struct arena_stats {
+  size_t peak;        // largest number of bytes in use
+  long   allocations;
+  long   releases;
+  int    blocks;
+  size_t capacity;    // bytes of all the blocks
+} arena_stats;
+
+typedef struct arena {
+  arena_block* first;
+  arena_block* block; // current block, NULL before the first allocation since a release to the start
+  size_t       used;  // bytes used in block
+  size_t       size;  // bytes in use in all the blocks, including the ends of blocks skipped
+  arena_stats  stats;
+} arena;
+
+typedef struct arena_mark {
+  arena_block* block;
+  size_t       used;
+  size_t       size;
+} arena_mark;
+
+arena arena_empty();
+void arena_free(arena* a);
+// Never NULL : aborts if memory is exhausted
+void* arena_alloc(arena* a, size_t bytes);
+
+static inline arena_mark arena_get_mark(const arena* a){
+  arena_mark m = { a->block, a->used, a->size };
+  return m;
+}
+
+// Frees the allocations made since m was taken
+static inline void arena_release(arena* a, arena_mark m){
+  a->block = m.block;
+  a->used  = m.used;
+  a->size  = m.size;
+  a->stats.releases += 1;
+}
+
+#endif
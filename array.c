@@ -1,12 +1,8 @@
 #include "array.h"
 
-int_array int_array_empty(){
-  int_array a;
-  a.size       = 0;
-  a.bufferSize = 0;
-  a.array      = NULL;
-  return a;
-}
+ARRAY_DEFINE(int_array, int)
+ARRAY_DEFINE(int_array_array, int_array)
+ARRAY_DEFINE(int_array_pair_array, int_array_pair)
 
 int_array int_array_new(int size){
   int_array a;
@@ -16,6 +12,14 @@ int_array int_array_new(int size){
   return a;
 }
 
+int_array int_array_arena(arena* a, int size){
+  int_array array;
+  array.size       = size;
+  array.bufferSize = size;
+  array.array      = arena_alloc(a, (size_t) size * sizeof(int));
+  return array;
+}
+
 void int_array_free(int_array *array){
   if(array->array){
     free(array->array);
@@ -23,68 +27,66 @@ void int_array_free(int_array *array){
 }
 
 int_array int_array_copy(int_array* array){
-  int_array a;
-  a.size = array->size;
-  a.bufferSize = a.size;
-  if(a.size != 0){
-    a.array = malloc(a.size * sizeof(int));
-    for(int i = 0; i < a.size; ++i){
-      a.array[i] = array->array[i];
-    }
-  }else{
-    a.array = NULL;
-  }
-  return a;
+  return int_array_shallow_copy(array);
 }
 
 void int_array_append(int_array* array, int value){
-  if(array->size < array->bufferSize){
-    array->array[array->size] = value;
-    array->size += 1;
-  }else{
-    int nBufferSize = (3 * array->bufferSize) / 2 + 1;
-    int* a = malloc(nBufferSize * sizeof(int));
-    for(int i = 0; i < array->size; ++i){
-      a[i] = array->array[i];
-    }
-    a[array->size] = value;
-    array->size += 1;
-    if(array->array){
-      free(array->array);
-    }
-    array->array = a;
-    array->bufferSize = nBufferSize;
-  }
+  *int_array_push(array) = value;
 }
 
-bool int_array_binary_search(int_array* array, int value){
-  assert(array != NULL);
-  if(array->size == 0){
+bool int_binary_search(const int* array, int size, int value){
+  if(size == 0){
     return false;
   }
-  int lo = 0, hi = array->size-1;
+  int lo = 0, hi = size-1;
   while(lo != hi){
     int mid = (lo + hi) / 2;
-    if(value > array->array[mid]){
+    if(value > array[mid]){
       lo = mid + 1;
     }else{
       hi = mid;
     }
   }
-  return value == array->array[lo];
+  return value == array[lo];
+}
+
+bool int_array_binary_search(int_array* array, int value){
+  assert(array != NULL);
+  return int_binary_search(array->array, array->size, value);
+}
+
+// The context is the comparison function
+typedef int (*int_cmp_f)(int, int);
+typedef int (*int_array_cmp_f)(int_array*, int_array*);
+
+#define INT_CMP_LESS(context, a, b)       ((*(const int_cmp_f*) (context))((a), (b)) < 0)
+#define INT_LESS(context, a, b)           ((a) < (b))
+#define INT_ARRAY_CMP_LESS(context, a, b) int_array_cmp_less((context), (a), (b))
+#define INT_ARRAY_LESS(context, a, b)     int_array_less((a), (b))
+#define UINT64_LESS(context, a, b)        ((a) < (b))
+#define HASH_KEY_LESS(context, a, b)      hash_key_less((a), (b))
+
+static inline bool int_array_cmp_less(const void* context, int_array a, int_array b){
+  return (*(const int_array_cmp_f*) context)(&a, &b) < 0;
+}
+
+static inline bool int_array_less(int_array a, int_array b){
+  return int_array_compare(&a, &b) < 0;
 }
 
+ARRAY_SORT_DEFINE(int_sort_cmp, int, INT_CMP_LESS)
+ARRAY_SORT_DEFINE(int_sort_less, int, INT_LESS)
+ARRAY_SORT_DEFINE(int_array_sort_cmp, int_array, INT_ARRAY_CMP_LESS)
+ARRAY_SORT_DEFINE(int_array_sort_array_less, int_array, INT_ARRAY_LESS)
+ARRAY_SORT_DEFINE(uint64_sort_less, uint64_t, UINT64_LESS)
+ARRAY_SORT_DEFINE(hash_key_sort_less, hash_key, HASH_KEY_LESS)
+
 void int_array_sort(int_array* array, int (*cmp)(int, int)){
-  int qsort_cmp(const void* a, const void* b){
-    int const* pa = a;
-    int const* pb = b;
-    return cmp(*pa, *pb);
-  };
-  qsort(array->array, array->size, sizeof(int), qsort_cmp);
+  int_sort_cmp(array->array, array->size, &cmp);
 }
 
 void int_array_sort_less(int_array* array){
-  int_array_sort(array, int_compare);
+  int_sort_less(array->array, array->size, NULL);
 }
 
 void int_array_sort_less_bounded(int_array* array, int_array* tmp){
@@ -102,6 +104,164 @@ void int_array_sort_less_bounded(int_array* array, int_array* tmp){
   }
 }
 
+void uint64_sort(uint64_t* array, int size){
+  uint64_sort_less(array, size, NULL);
+}
+
+void hash_key_insertion_sort(hash_key* array, int size){
+  hash_key_sort_less_insertion(array, size, NULL);
+}
+
+void hash_key_sort(hash_key* array, int size){
+  hash_key_sort_less(array, size, NULL);
+}
+
+void hash_key_radix_sort(hash_key* array, int size, hash_key* buffer){
+  int count[8][256];
+  memset(count, 0, sizeof(count));
+  for(int i = 0; i < size; ++i){
+    uint64_t h = array[i].hash;
+    for(int d = 0; d < 8; ++d){
+      count[d][(h >> (8 * d)) & 0xFF] += 1;
+    }
+  }
+  hash_key* from = array;
+  hash_key* to   = buffer;
+  for(int d = 0; d < 8 && size > 0; ++d){
+    int* c = count[d];
+    if(c[(from[0].hash >> (8 * d)) & 0xFF] == size){
+      continue;
+    }
+    int sum = 0;
+    for(int b = 0; b < 256; ++b){
+      int x = c[b];
+      c[b] = sum;
+      sum += x;
+    }
+    for(int i = 0; i < size; ++i){
+      hash_key k = from[i];
+      to[c[(k.hash >> (8 * d)) & 0xFF]++] = k;
+    }
+    SWAP(hash_key*, from, to);
+  }
+  if(from != array){
+    memcpy(array, from, size * sizeof(hash_key));
+  }
+}
+
+typedef struct hash_key_radix_pass {
+  const hash_key* from;
+  hash_key*       to;
+  int             digit;   // -1 : all the digits are counted
+  int           (*count)[8][256]; // count[t][d][b], then first position of the keys of thread t in bucket b
+} hash_key_radix_pass;
+
+void hash_key_radix_count(void* context, int t, int begin, int end){
+  hash_key_radix_pass* r = context;
+  int (*c)[256] = r->count[t];
+  memset(c, 0, sizeof(r->count[t]));
+  for(int i = begin; i < end; ++i){
+    uint64_t h = r->from[i].hash;
+    if(r->digit < 0){
+      for(int d = 0; d < 8; ++d){
+        c[d][(h >> (8 * d)) & 0xFF] += 1;
+      }
+    }else{
+      c[r->digit][(h >> (8 * r->digit)) & 0xFF] += 1;
+    }
+  }
+}
+
+void hash_key_radix_scatter(void* context, int t, int begin, int end){
+  hash_key_radix_pass* r = context;
+  int* c = r->count[t][r->digit];
+  for(int i = begin; i < end; ++i){
+    hash_key k = r->from[i];
+    r->to[c[(k.hash >> (8 * r->digit)) & 0xFF]++] = k;
+  }
+}
+
+void hash_key_radix_sort_pool(hash_key* array, int size, hash_key* buffer, thread_pool* pool){
+  int threads = thread_pool_threads(pool);
+  hash_key_radix_pass r;
+  r.count = malloc(threads * sizeof(*r.count));
+  r.from  = array;
+  r.to    = buffer;
+  r.digit = -1;
+  thread_pool_for(pool, size, hash_key_radix_count, &r);
+  // Digits shared by all the keys
+  bool skip[8];
+  for(int d = 0; d < 8 && size > 0; ++d){
+    int total = 0;
+    int b = (array[0].hash >> (8 * d)) & 0xFF;
+    for(int t = 0; t < threads; ++t){
+      total += r.count[t][d][b];
+    }
+    skip[d] = total == size;
+  }
+  hash_key* from = array;
+  hash_key* to   = buffer;
+  for(int d = 0; d < 8 && size > 0; ++d){
+    if(skip[d]){
+      continue;
+    }
+    r.from  = from;
+    r.to    = to;
+    r.digit = d;
+    thread_pool_for(pool, size, hash_key_radix_count, &r);
+    int sum = 0;
+    for(int b = 0; b < 256; ++b){
+      for(int t = 0; t < threads; ++t){
+        int x = r.count[t][d][b];
+        r.count[t][d][b] = sum;
+        sum += x;
+      }
+    }
+    thread_pool_for(pool, size, hash_key_radix_scatter, &r);
+    SWAP(hash_key*, from, to);
+  }
+  if(from != array){
+    memcpy(array, from, size * sizeof(hash_key));
+  }
+  free(r.count);
+}
+
+void hash_key_sort_buffered(hash_key* array, int size, hash_key* buffer){
+  if(size <= HASH_KEY_INSERTION_MAX){
+    hash_key_sort_less_insertion(array, size, NULL);
+  }else if(size < HASH_KEY_RADIX_MIN){
+    hash_key_sort_less(array, size, NULL);
+  }else{
+    hash_key_radix_sort(array, size, buffer);
+  }
+}
+
+// Stable, from a to b, by (a[i].hash >> shift) & 0xFFFFFFFF
+void hash_key_counting_sort(const hash_key* a, hash_key* b, int size, int shift, int_array* tmp){
+  memset(tmp->array, 0, tmp->size * sizeof(int));
+  for(int i = 0; i < size; ++i){
+    uint32_t x = a[i].hash >> shift;
+    assert(x < (uint32_t) tmp->size);
+    tmp->array[x] += 1;
+  }
+  int cur = 0;
+  for(int i = 0; i < tmp->size; ++i){
+    int c = tmp->array[i];
+    tmp->array[i] = cur;
+    cur += c;
+  }
+  for(int i = 0; i < size; ++i){
+    uint32_t x = a[i].hash >> shift;
+    b[tmp->array[x]] = a[i];
+    tmp->array[x] += 1;
+  }
+}
+
+void hash_key_sort_bounded(hash_key* array, int size, hash_key* buffer, int_array* tmp){
+  hash_key_counting_sort(array, buffer, size, 0, tmp);
+  hash_key_counting_sort(buffer, array, size, 32, tmp);
+}
+
 bool int_array_unsorted_compare_bounded(int_array* a, int_array* b, int_array* tmp){
   assert(a != NULL && b != NULL);
   assert(a->size == b->size);
@@ -140,23 +300,15 @@ int_array trivial_isomorphism(int size){
   return iso;
 }
 
-int_array random_isomorphism(int size){
+int_array random_isomorphism(int size, uint64_t* state){
   int_array iso = trivial_isomorphism(size);
   for(int i = 0; i < size; ++i){
-    int j = i + rand()% (size-i);
+    int j = i + random_int(state, size - i);
     SWAP(int, iso.array[i], iso.array[j]);
   }
   return iso;
 }
 
-int_array_array int_array_array_empty(){
-  int_array_array a;
-  a.size       = 0;
-  a.bufferSize = 0;
-  a.array      = NULL;
-  return a;
-}
-
 int_array_array int_array_array_new(int size){
   int_array_array a;
   a.size       = size;
@@ -176,38 +328,15 @@ void int_array_array_free(int_array_array* array){
 }
 
 int_array_array int_array_array_copy(int_array_array* array){
-  int_array_array a;
-  a.size = array->size;
-  a.bufferSize = a.size;
-  if(a.size != 0){
-    a.array = malloc(a.size * sizeof(int_array));
-    for(int i = 0; i < a.size; ++i){
-      a.array[i] = int_array_copy(&array->array[i]);
-    }
-  }else{
-    a.array = NULL;
+  int_array_array a = int_array_array_shallow_copy(array);
+  for(int i = 0; i < a.size; ++i){
+    a.array[i] = int_array_copy(&array->array[i]);
   }
   return a;
 }
 
 void int_array_array_append(int_array_array* array, int_array value){
-  if(array->size < array->bufferSize){
-    array->array[array->size] = value;
-    array->size += 1;
-  }else{
-    int nBufferSize = (3 * array->bufferSize) / 2 + 1;
-    int_array* a = malloc(nBufferSize * sizeof(int_array));
-    for(int i = 0; i < array->size; ++i){
-      a[i] = array->array[i];
-    }
-    a[array->size] = value;
-    array->size += 1;
-    if(array->array){
-      free(array->array);
-    }
-    array->array = a;
-    array->bufferSize = nBufferSize;
-  }
+  *int_array_array_push(array) = value;
 }
 
 int int_array_back(int_array* array){
@@ -221,25 +350,14 @@ void int_array_remove_back(int_array* array){
 }
 
 void int_array_array_sort(int_array_array* array, int (*cmp)(int_array*, int_array*)){
-  int qsort_cmp(const void* a, const void* b){
-    return cmp((int_array*) a, (int_array*) b);
-  };
-  qsort(array->array, array->size, sizeof(int), qsort_cmp);
+  int_array_sort_cmp(array->array, array->size, &cmp);
 }
 
 void int_array_array_sort_less(int_array_array* array){
-  int_array_array_sort(array, int_array_compare);
+  int_array_sort_array_less(array->array, array->size, NULL);
 }
 
 
-int_array_pair_array int_array_pair_array_empty(){
-  int_array_pair_array a;
-  a.size       = 0;
-  a.bufferSize = 0;
-  a.array      = NULL;
-  return a;
-}
-
 int_array_pair_array int_array_pair_array_new(int size){
   int_array_pair_array a;
   a.size       = size;
@@ -261,41 +379,14 @@ void int_array_pair_array_free(int_array_pair_array* array){
 }
 
 int_array_pair_array int_array_pair_array_copy(int_array_pair_array* array){
-  assert(array != NULL);
-  int_array_pair_array a;
-  a.size = array->size;
-  a.bufferSize = a.size;
-  if(a.size != 0){
-    a.array = malloc(a.size * 2 * sizeof(int_array));
-    for(int i = 0; i < a.size; ++i){
-      a.array[i][0] = int_array_copy(&array->array[i][0]);
-      a.array[i][1] = int_array_copy(&array->array[i][1]);
-    }
-  }else{
-    a.array = NULL;
+  int_array_pair_array a = int_array_pair_array_shallow_copy(array);
+  for(int i = 0; i < a.size; ++i){
+    a.array[i][0] = int_array_copy(&array->array[i][0]);
+    a.array[i][1] = int_array_copy(&array->array[i][1]);
   }
   return a;
 }
 
 void int_array_pair_array_append(int_array_pair_array* array, int_array value[2]){
-  if(array->size < array->bufferSize){
-    array->array[array->size][0] = value[0];
-    array->array[array->size][1] = value[1];
-    array->size += 1;
-  }else{
-    int nBufferSize = (3 * array->bufferSize) / 2 + 1;
-    int_array (*a)[2] = malloc(nBufferSize * 2 * sizeof(int_array));
-    for(int i = 0; i < array->size; ++i){
-      a[i][0] = array->array[i][0];
-      a[i][1] = array->array[i][1];
-    }
-    a[array->size][0] = value[0];
-    a[array->size][1] = value[1];
-    array->size += 1;
-    if(array->array){
-      free(array->array);
-    }
-    array->array = a;
-    array->bufferSize = nBufferSize;
-  }
+  memcpy(int_array_pair_array_push(array), value, sizeof(int_array_pair));
 }
@@ -4,23 +4,156 @@
 #include "string.h"
 #include "stdlib.h"
 #include "stdbool.h"
+#include "stdint.h"
 #include "assert.h"
 #include "util.h"
+#include "thread_pool.h"
+#include "arena.h"
+
+/*
+ * Vectors : struct name { size, bufferSize, array } of values of type T.
+ * ARRAY_DECLARE(name, T) declares the type and the functions common to the vectors, ARRAY_DEFINE(name, T)
+ * defines them in array.c. Buffers grow by half with realloc, values are moved and copied with memcpy :
+ * the shallow copy of a vector of vectors shares their buffers
+ *
+ * name_empty        : no buffer
+ * name_reserve      : room for bufferSize values
+ * name_grow         : room for n more values, the buffer growing by half at least
+ * name_shrink       : buffer of size values, freed if empty
+ * name_shallow_copy : buffer of size values, copied
+ * name_push         : new uninitialized value at the end
+ */
+
+#define ARRAY_DECLARE(name, T)                          \
+  typedef struct name{                                  \
+    int size;                                           \
+    int bufferSize;                                     \
+    T*  array;                                          \
+  } name;                                               \
+  name name##_empty();                                  \
+  void name##_reserve(name* array, int bufferSize);     \
+  void name##_grow(name* array, int n);                 \
+  void name##_shrink(name* array);                      \
+  name name##_shallow_copy(const name* array);          \
+  static inline T* name##_push(name* array){            \
+    if(array->size == array->bufferSize){               \
+      name##_grow(array, 1);                            \
+    }                                                   \
+    array->size += 1;                                   \
+    return &array->array[array->size - 1];              \
+  }
+
+#define ARRAY_DEFINE(name, T)                                                   \
+  name name##_empty(){                                                          \
+    name a;                                                                     \
+    a.size       = 0;                                                           \
+    a.bufferSize = 0;                                                           \
+    a.array      = NULL;                                                        \
+    return a;                                                                   \
+  }                                                                             \
+  void name##_reserve(name* array, int bufferSize){                             \
+    assert(array != NULL);                                                      \
+    if(bufferSize > array->bufferSize){                                         \
+      array->array      = realloc(array->array, (size_t) bufferSize * sizeof(T)); \
+      array->bufferSize = bufferSize;                                           \
+    }                                                                           \
+  }                                                                             \
+  void name##_grow(name* array, int n){                                         \
+    assert(array != NULL && n >= 0);                                            \
+    if(array->bufferSize - array->size < n){                                    \
+      int b = array->bufferSize + array->bufferSize / 2 + 1;                    \
+      name##_reserve(array, b > array->size + n ? b : array->size + n);         \
+    }                                                                           \
+  }                                                                             \
+  void name##_shrink(name* array){                                              \
+    assert(array != NULL);                                                      \
+    if(array->bufferSize > array->size){                                        \
+      if(array->size == 0){                                                     \
+        free(array->array);                                                     \
+        array->array = NULL;                                                    \
+      }else{                                                                    \
+        array->array = realloc(array->array, (size_t) array->size * sizeof(T)); \
+      }                                                                         \
+      array->bufferSize = array->size;                                          \
+    }                                                                           \
+  }                                                                             \
+  name name##_shallow_copy(const name* array){                                  \
+    assert(array != NULL);                                                      \
+    name a = name##_empty();                                                    \
+    if(array->size != 0){                                                       \
+      a.size       = array->size;                                               \
+      a.bufferSize = array->size;                                               \
+      a.array      = malloc((size_t) array->size * sizeof(T));                  \
+      memcpy(a.array, array->array, (size_t) array->size * sizeof(T));          \
+    }                                                                           \
+    return a;                                                                   \
+  }
+
+/*
+ * ARRAY_SORT_DEFINE(name, T, less) defines static void name(T* array, int size, const void* context) :
+ * quicksort on the median of 3, recursing on the smaller side only, O(log size) stack,
+ * then insertion sort (name_insertion) on ranges of up to 16 values. Not stable.
+ * less(context, a, b) is a macro or a function, expanded in the sort so that it can be inlined
+ */
+
+#define ARRAY_SORT_DEFINE(name, T, less)                                      \
+  static void name##_insertion(T* array, int size, const void* context){     \
+    (void) context;                                                           \
+    for(int i = 1; i < size; ++i){                                            \
+      T x = array[i];                                                         \
+      int j = i;                                                              \
+      while(j > 0 && less(context, x, array[j - 1])){                         \
+        array[j] = array[j - 1];                                              \
+        j -= 1;                                                               \
+      }                                                                       \
+      array[j] = x;                                                           \
+    }                                                                         \
+  }                                                                           \
+  static void name(T* array, int size, const void* context){                 \
+    while(size > 16){                                                         \
+      T a = array[0], b = array[size / 2], c = array[size - 1];               \
+      T pivot = less(context, a, b)                                           \
+        ? (less(context, b, c) ? b : (less(context, a, c) ? c : a))           \
+        : (less(context, a, c) ? a : (less(context, b, c) ? c : b));          \
+      int i = 0, j = size - 1;                                                \
+      while(i <= j){                                                          \
+        while(less(context, array[i], pivot)){                                \
+          i += 1;                                                             \
+        }                                                                     \
+        while(less(context, pivot, array[j])){                                \
+          j -= 1;                                                             \
+        }                                                                     \
+        if(i <= j){                                                           \
+          SWAP(T, array[i], array[j]);                                        \
+          i += 1;                                                             \
+          j -= 1;                                                             \
+        }                                                                     \
+      }                                                                       \
+      if(j + 1 < size - i){                                                   \
+        name(array, j + 1, context);                                          \
+        array += i;                                                           \
+        size  -= i;                                                           \
+      }else{                                                                  \
+        name(array + i, size - i, context);                                   \
+        size = j + 1;                                                         \
+      }                                                                       \
+    }                                                                         \
+    name##_insertion(array, size, context);                                   \
+  }
 
 // int_array
 
-typedef struct int_array{
-  int  size;
-  int  bufferSize;
-  int* array;
-} int_array;
+ARRAY_DECLARE(int_array, int)
 
-int_array int_array_empty();
 int_array int_array_new(int size);
+// Room for size values in a, not to be freed nor grown : it lives until a is released
+int_array int_array_arena(arena* a, int size);
 void int_array_free(int_array *array);
 int_array int_array_copy(int_array* array);
 void int_array_append(int_array* array, int value);
+bool int_binary_search(const int* array, int size, int value);
 bool int_array_binary_search(int_array* array, int value);
+// Through a function pointer : ARRAY_SORT_DEFINE sorts with a comparison that can be inlined
 void int_array_sort(int_array* array, int (*cmp)(int, int));
 void int_array_sort_less(int_array* array);
 void int_array_sort_less_bounded(int_array* array, int_array* tmp);
@@ -29,19 +162,46 @@ int int_array_compare(int_array* a, int_array* b);
 int int_array_back(int_array* array);
 void int_array_remove_back(int_array* array);
 
+// In place, no allocation : quicksort with insertion sort on small ranges
+void uint64_sort(uint64_t* array, int size);
+
+// hash_key : a 64 bits hash and the value it belongs to, sorted by hash then value
+
+typedef struct hash_key{
+  uint64_t hash;
+  int      value;
+} hash_key;
+
+static inline bool hash_key_less(hash_key a, hash_key b){
+  return a.hash < b.hash || (a.hash == b.hash && a.value < b.value);
+}
+
+// Same algorithm as uint64_sort
+void hash_key_sort(hash_key* array, int size);
+void hash_key_insertion_sort(hash_key* array, int size);
+// LSD radix sort on the 8 bytes of the hashes, stable : equal hashes keep their order
+// Bytes shared by all the keys are skipped, buffer holds size keys
+void hash_key_radix_sort(hash_key* array, int size, hash_key* buffer);
+// Same result, each pass being split between the threads of pool : every thread counts the bytes of its range,
+// then moves its keys after those of the previous threads
+void hash_key_radix_sort_pool(hash_key* array, int size, hash_key* buffer, thread_pool* pool);
+
+// Sorts keys by hash, equal hashes are next to each other in an unspecified order
+// Insertion sort up to HASH_KEY_INSERTION_MAX keys, radix sort from HASH_KEY_RADIX_MIN keys, quicksort between
+#define HASH_KEY_INSERTION_MAX 16
+#define HASH_KEY_RADIX_MIN     1024
+void hash_key_sort_buffered(hash_key* array, int size, hash_key* buffer);
+// Stable counting sorts on the low then the high 32 bits of the hashes, both smaller than tmp->size
+// buffer holds size keys
+void hash_key_sort_bounded(hash_key* array, int size, hash_key* buffer, int_array* tmp);
 
 int_array trivial_isomorphism(int size);
-int_array random_isomorphism(int size);
+int_array random_isomorphism(int size, uint64_t* state);
 
 // int_array_array
 
-typedef struct int_array_array{
-  int        size;
-  int        bufferSize;
-  int_array* array;
-} int_array_array;
+ARRAY_DECLARE(int_array_array, int_array)
 
-int_array_array int_array_array_empty();
 int_array_array int_array_array_new(int size);
 void int_array_array_free(int_array_array* array);
 int_array_array int_array_array_copy(int_array_array* array);
@@ -51,13 +211,10 @@ void int_array_array_sort_less(int_array_array* array);
 
 // int_array_pair_array
 
-typedef struct int_array_pair_array{
-  int       size;
-  int       bufferSize;
-  int_array (*array)[2];
-} int_array_pair_array;
+typedef int_array int_array_pair[2];
+
+ARRAY_DECLARE(int_array_pair_array, int_array_pair)
 
-int_array_pair_array int_array_pair_array_empty();
 int_array_pair_array int_array_pair_array_new(int size);
 void int_array_pair_array_free(int_array_pair_array* array);
 int_array_pair_array int_array_pair_array_copy(int_array_pair_array* array);
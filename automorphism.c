@@ -0,0 +1,425 @@
+#include "automorphism.h"
+
+#include "assert.h"
+#include "math.h"
+#include "stdint.h"
+#include "stdio.h"
+#include "string.h"
+
+#include "util.h"
+#include "union_find.h"
+
+automorphism_group automorphism_group_empty(){
+  automorphism_group group;
+  group.generators = int_array_array_empty();
+  group.orbits     = int_array_empty();
+  group.indices    = int_array_empty();
+  return group;
+}
+
+void automorphism_group_free(automorphism_group* group){
+  assert(group != NULL);
+  int_array_array_free(&group->generators);
+  int_array_free(&group->orbits);
+  int_array_free(&group->indices);
+  *group = automorphism_group_empty();
+}
+
+double automorphism_group_order_log10(automorphism_group* group){
+  double order = 0.;
+  for(int d = 0; d < group->indices.size; ++d){
+    order += log10(group->indices.array[d]);
+  }
+  return order;
+}
+
+// Digits in base 10^9, least significant first
+#define AUTOMORPHISM_BASE 1000000000u
+
+char* automorphism_group_order(automorphism_group* group){
+  int capacity = 1;
+  for(int d = 0; d < group->indices.size; ++d){
+    // An index below 2^31 adds at most 2 digits
+    capacity += 2;
+  }
+  uint32_t* digits = malloc(capacity * sizeof(uint32_t));
+  digits[0] = 1;
+  int size = 1;
+  for(int d = 0; d < group->indices.size; ++d){
+    uint64_t carry = 0;
+    for(int i = 0; i < size; ++i){
+      uint64_t x = (uint64_t) digits[i] * group->indices.array[d] + carry;
+      digits[i] = x % AUTOMORPHISM_BASE;
+      carry     = x / AUTOMORPHISM_BASE;
+    }
+    while(carry != 0){
+      digits[size] = carry % AUTOMORPHISM_BASE;
+      carry /= AUTOMORPHISM_BASE;
+      size += 1;
+    }
+  }
+  char* order = malloc(9 * size + 1);
+  int length = sprintf(order, "%u", digits[size - 1]);
+  for(int i = size - 2; i >= 0; --i){
+    length += sprintf(order + length, "%09u", digits[i]);
+  }
+  free(digits);
+  return order;
+}
+
+/*
+ * automorphism_search
+ *
+ * Buffers of the extension of a node to an automorphism. Outside the cells rearranged since the mark of a candidate,
+ * both sides of the partition are those of the first path, the same : gamma is the identity there,
+ * and only the vertices of those cells are mapped and checked
+ */
+
+typedef struct automorphism_search {
+  wl_search           s;
+  automorphism_group* group;
+  int_array           gamma;      // side 0 -> side 1, the identity between extensions, -1 if not mapped yet
+  int_array           inverse;
+  int_array           queue;
+  int_array           head;       // head.array[c] : first unmapped neighbour in cell c of the image of a vertex
+  int_array           next;
+  int_array           touched;    // vertices of the cells rearranged since the mark
+  int_array           seen;       // seen.array[v] == stamp : v is touched
+  int_array           cursor;     // cursor.array[c] : first position of cell c that may be unmapped on side 1
+  int_array           cell_seen;  // cell_seen.array[c] == stamp : cursor.array[c] is set
+  int_array           moved;      // pairs v, gamma(v) of the last extension
+  int                 stamp;
+} automorphism_search;
+
+void automorphism_map(automorphism_search* a, int v, int w){
+  a->gamma.array[v]   = w;
+  a->inverse.array[w] = v;
+  int_array_append(&a->queue, v);
+}
+
+// Maps the unmapped neighbours of the vertices of the queue, in g or its reverse, to neighbours of their images
+bool automorphism_propagate(automorphism_search* a){
+  wl_partition* p = &a->s.ws->p;
+  int* gamma = a->gamma.array;
+  int* head  = a->head.array;
+  int* next  = a->next.array;
+  for(int i = 0; i < a->queue.size; ++i){
+    int u = a->queue.array[i];
+    TWICE(k){
+      graph* g = k == 0 ? a->s.g[0] : a->s.rg[0];
+      int* nu = graph_neighbours(g, u);
+      int* nw = graph_neighbours(g, gamma[u]);
+      int degree = graph_degree(g, u);
+      if(degree != graph_degree(g, gamma[u])){
+        return false;
+      }
+      // Unmapped neighbours of the image, by cell
+      for(int j = degree - 1; j >= 0; --j){
+        int y = nw[j];
+        if(a->inverse.array[y] < 0){
+          int c = p->elements[1].array[y];
+          next[y] = head[c];
+          head[c] = y;
+        }
+      }
+      bool valid = true;
+      for(int j = 0; j < degree && valid; ++j){
+        int x = nu[j];
+        if(gamma[x] >= 0){
+          continue;
+        }
+        int c = p->elements[0].array[x];
+        int y = head[c];
+        if(y < 0){
+          valid = false;
+        }else{
+          head[c] = next[y];
+          automorphism_map(a, x, y);
+        }
+      }
+      for(int j = 0; j < degree; ++j){
+        head[p->elements[1].array[nw[j]]] = -1;
+      }
+      if(!valid){
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// gamma preserves the edges of the vertices it moves, in g and its reverse
+bool automorphism_check(automorphism_search* a){
+  int* gamma = a->gamma.array;
+  for(int i = 0; i < a->touched.size; ++i){
+    int v = a->touched.array[i];
+    if(gamma[v] == v){
+      continue;
+    }
+    TWICE(k){
+      graph* g = k == 0 ? a->s.g[0] : a->s.rg[0];
+      if(graph_degree(g, v) != graph_degree(g, gamma[v])){
+        return false;
+      }
+      int* nb = graph_neighbours(g, v);
+      for(int j = 0; j < graph_degree(g, v); ++j){
+        if(!graph_has_edge(g, gamma[v], gamma[nb[j]])){
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Vertices of the cells saved or individualized since trail
+void automorphism_touched(automorphism_search* a, int trail){
+  wl_partition* p = &a->s.ws->p;
+  a->stamp += 1;
+  a->touched.size = 0;
+  for(int i = trail; i < p->trail_size; ++i){
+    wl_trail_entry* e = &p->trail[i];
+    if(e->kind != WL_TRAIL_SPLIT && e->kind != WL_TRAIL_INDIVIDUALIZE){
+      continue;
+    }
+    for(int j = e->a; j < e->a + e->b; ++j){
+      int v = p->perm[0].array[j];
+      if(a->seen.array[v] != a->stamp){
+        a->seen.array[v] = a->stamp;
+        int_array_append(&a->touched, v);
+      }
+    }
+  }
+}
+
+/*
+ * Maps the touched vertices of side 0 of the stable partition to side 1 : singletons first, vertices in the same cell
+ * on both sides to themselves, then along the edges, each vertex to a neighbour of the image of its neighbour
+ * in the same cell, and the remaining ones by positions.
+ * Returns true if the mapping is an automorphism, moved then holds it. It always is for a discrete partition,
+ * and often is when both sides are refined in the same way, as in trees
+ */
+bool automorphism_extend(automorphism_search* a, int trail){
+  wl_partition* p = &a->s.ws->p;
+  int* gamma   = a->gamma.array;
+  int* inverse = a->inverse.array;
+  // The touched vertices are the same on both sides
+  automorphism_touched(a, trail);
+  for(int i = 0; i < a->touched.size; ++i){
+    int v = a->touched.array[i];
+    gamma[v]   = -1;
+    inverse[v] = -1;
+  }
+  a->queue.size = 0;
+  for(int i = 0; i < a->touched.size; ++i){
+    int v = a->touched.array[i];
+    int c = p->elements[0].array[v];
+    if(p->cell_size.array[c] == 1){
+      automorphism_map(a, v, p->perm[1].array[c]);
+    }
+  }
+  for(int i = 0; i < a->touched.size; ++i){
+    int v = a->touched.array[i];
+    if(gamma[v] < 0 && inverse[v] < 0 && p->elements[1].array[v] == p->elements[0].array[v]){
+      automorphism_map(a, v, v);
+    }
+  }
+  // Untouched neighbours of unmapped vertices are mapped to themselves
+  for(int i = 0; i < a->touched.size; ++i){
+    int v = a->touched.array[i];
+    if(gamma[v] >= 0){
+      continue;
+    }
+    TWICE(k){
+      graph* g = k == 0 ? a->s.g[0] : a->s.rg[0];
+      int* nb = graph_neighbours(g, v);
+      for(int j = 0; j < graph_degree(g, v); ++j){
+        if(a->seen.array[nb[j]] != a->stamp){
+          int_array_append(&a->queue, nb[j]);
+        }
+      }
+    }
+  }
+  bool valid = automorphism_propagate(a);
+  for(int i = 0; i < a->touched.size && valid; ++i){
+    int v = a->touched.array[i];
+    if(gamma[v] >= 0){
+      continue;
+    }
+    int c = p->elements[0].array[v];
+    if(a->cell_seen.array[c] != a->stamp){
+      a->cell_seen.array[c] = a->stamp;
+      a->cursor.array[c]    = c;
+    }
+    while(inverse[p->perm[1].array[a->cursor.array[c]]] >= 0){
+      a->cursor.array[c] += 1;
+    }
+    a->queue.size = 0;
+    automorphism_map(a, v, p->perm[1].array[a->cursor.array[c]]);
+    valid = automorphism_propagate(a);
+  }
+  valid = valid && automorphism_check(a);
+  a->moved.size = 0;
+  for(int i = 0; i < a->touched.size; ++i){
+    int v = a->touched.array[i];
+    if(valid && gamma[v] != v){
+      int_array_append(&a->moved, v);
+      int_array_append(&a->moved, gamma[v]);
+    }
+    gamma[v]   = v;
+    inverse[v] = v;
+  }
+  return valid;
+}
+
+/*
+ * The first path below the root, then bottom up the orbit of the vertex v individualized at each of its nodes.
+ * Below a candidate b, the refined partition is extended to an automorphism before searching.
+ * The nodes of the first path are frames on the stack of the workspace, as in wl_backtrack : the depth is only
+ * limited by memory
+ */
+void automorphism_backtrack(automorphism_search* a){
+  wl_search* s = &a->s;
+  wl_workspace* ws = s->ws;
+  wl_partition* p = &ws->p;
+  wl_orbits* o = &ws->orbits;
+  wl_frame_array* frames = &ws->frames;
+  int base = frames->size;
+  for(int depth = 0; ; ++depth){
+    ws->stats.nodes += 1;
+    if(depth > ws->stats.depth){
+      ws->stats.depth = depth;
+    }
+    // Both sides hold the same graph and the same path
+    bool valid = stable_partition(s->g, s->rg, p);
+    assert(valid);
+    (void) valid;
+
+    int c = wl_target_cell(s->g, s->rg, p, ws->target, &ws->count);
+    if(c == p->size){
+      int_array_reserve(&a->group->indices, depth);
+      a->group->indices.size = depth;
+      // Trivial orbits, inherited by the parent
+      wl_orbits_enter(o, depth);
+      wl_orbits_leave(o, depth);
+      break;
+    }
+    wl_frame* f = wl_frame_array_push(frames);
+    f->depth      = depth;
+    f->c          = c;
+    f->size       = p->cell_size.array[c];
+    f->candidates = p->perm[1].array + c;
+    // No progress to report
+    f->end        = 1;
+    f->j          = -1;
+    int v = p->perm[0].array[c + f->size - 1];
+    int x[2] = { v, v };
+    wl_orbits_set_path(o, depth, v);
+    wl_partition_mark(p);
+    wl_individualize(s->g, s->rg, p, c, x);
+  }
+
+  while(frames->size > base){
+    // The searches below push their frames above it
+    wl_frame f = frames->array[frames->size - 1];
+    frames->size -= 1;
+    int depth = f.depth, c = f.c, size = f.size;
+    wl_partition_undo(p);
+    int v = p->perm[0].array[c + size - 1];
+
+    // The automorphisms found below fix v_0 ... v_depth
+    wl_orbits_inherit(o, depth);
+    for(int j = 0; j < size; ++j){
+      int b = p->perm[1].array[c + j];
+      if(wl_orbits_explored(o, depth, b, &v, 1)){
+        continue;
+      }
+      // A successful search leaves its marks
+      int trail = p->trail_size;
+      int y[2] = { v, b };
+      wl_orbits_set_path(o, depth, b);
+      wl_partition_mark(p);
+      wl_individualize(s->g, s->rg, p, c, y);
+      bool found = false;
+      if(stable_partition(s->g, s->rg, p)){
+        // A search that succeeds leaves a discrete partition, which always extends
+        found = automorphism_extend(a, trail) || (wl_backtrack(s, depth + 1) && automorphism_extend(a, trail));
+      }else{
+        ws->stats.failures += 1;
+      }
+      wl_orbits_set_path(o, depth, v);
+      if(found && wl_orbits_add_moved(o, depth, &a->moved)){
+        ws->stats.automorphisms += 1;
+      }
+      while(p->trail_size > trail){
+        wl_partition_undo(p);
+      }
+    }
+    a->group->indices.array[depth] = int_union_find_class_size(&o->orbits[depth], v);
+    wl_orbits_leave(o, depth);
+  }
+}
+
+automorphism_group graph_automorphism_group_workspace(wl_workspace* ws, graph* g, graph* rg){
+  assert(ws != NULL && g != NULL);
+  automorphism_group group = automorphism_group_empty();
+  automorphism_search a;
+  graph* g_[2] = { g, g };
+  graph* rg_[2] = { rg, rg };
+  wl_search_init(&a.s, ws, g_, rg_);
+  a.group = &group;
+  if(g->size > 0){
+    int_array* buffers[10] = { &a.gamma, &a.inverse, &a.queue, &a.head, &a.next,
+                               &a.touched, &a.seen, &a.cursor, &a.cell_seen, &a.moved };
+    for(int i = 0; i < 10; ++i){
+      *buffers[i] = int_array_new(g->size);
+    }
+    for(int v = 0; v < g->size; ++v){
+      a.gamma.array[v]     = v;
+      a.inverse.array[v]   = v;
+      a.head.array[v]      = -1;
+      a.seen.array[v]      = 0;
+      a.cell_seen.array[v] = 0;
+    }
+    a.stamp = 0;
+    bool valid = wl_graph_degree_partition_into(a.s.g, &ws->p);
+    assert(valid);
+    (void) valid;
+    automorphism_backtrack(&a);
+    wl_partition_trail_clear(&ws->p);
+    for(int i = 0; i < 10; ++i){
+      int_array_free(buffers[i]);
+    }
+  }
+
+  int_array_array* automorphisms = &ws->orbits.automorphisms;
+  for(int i = 0; i < automorphisms->size; ++i){
+    int_array_array_append(&group.generators, int_array_copy(&automorphisms->array[i]));
+  }
+  int_union_find u = int_union_find_new(g->size);
+  for(int i = 0; i < group.generators.size; ++i){
+    int_array* gamma = &group.generators.array[i];
+    int_union_find_union_pairs(&u, gamma->array, gamma->size / 2);
+  }
+  // The root of a class first receives its smallest vertex
+  group.orbits = int_array_new(g->size);
+  for(int v = 0; v < g->size; ++v){
+    group.orbits.array[v] = -1;
+  }
+  for(int v = 0; v < g->size; ++v){
+    int r = int_union_find_find(&u, v);
+    if(group.orbits.array[r] < 0){
+      group.orbits.array[r] = v;
+    }
+    group.orbits.array[v] = group.orbits.array[r];
+  }
+  int_union_find_free(&u);
+  return group;
+}
+
+automorphism_group graph_automorphism_group(graph* g){
+  wl_workspace ws = wl_workspace_new();
+  automorphism_group group = graph_automorphism_group_workspace(&ws, g, NULL);
+  wl_workspace_free(&ws);
+  return group;
+}
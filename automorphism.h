@@ -0,0 +1,42 @@
+#ifndef ALGO_GISO_AUTOMORPHISM_H
+#define ALGO_GISO_AUTOMORPHISM_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "array.h"
+#include "graph.h"
+#include "wl.h"
+
+/*
+ * Automorphism group
+ *
+ * The WL search tree of the graph against itself is explored as for a canonical form, first along the path
+ * that individualizes the same vertex v_d on both sides at each depth d, down to the identity leaf.
+ * Then, from the deepest node up, every vertex b of the target cell is tried against v_d on the second side,
+ * unless b is already in the orbit of v_d : an isomorphism found is an automorphism fixing v_0 ... v_{d-1}
+ * and mapping v_d to b. The orbit of v_d in the stabilizer of v_0 ... v_{d-1} is then complete, and the order
+ * of the group is the product of the sizes of these orbits.
+ *
+ * Automorphisms are kept when they merge orbits (wl_orbits), they generate the group.
+ * The searches below each candidate prune with the automorphisms found so far.
+ * Generators only list the vertices they move : a tree may need one for each pair of similar sibling subtrees
+ */
+
+typedef struct automorphism_group {
+  int_array_array generators; // pairs v, gamma(v) of the vertices moved
+  int_array       orbits;  // orbits.array[v] : smallest vertex of the orbit of v
+  int_array       indices; // indices.array[d] : orbit of v_d in the stabilizer of v_0 ... v_{d-1}
+} automorphism_group;
+
+automorphism_group automorphism_group_empty();
+void automorphism_group_free(automorphism_group* group);
+// Base 10 logarithm of the order
+double automorphism_group_order_log10(automorphism_group* group);
+// Order in decimal, to be freed by the caller
+char* automorphism_group_order(automorphism_group* group);
+
+// rg may be NULL, statistics are added to those of the workspace
+automorphism_group graph_automorphism_group_workspace(wl_workspace* ws, graph* g, graph* rg);
+automorphism_group graph_automorphism_group(graph* g);
+
+#endif
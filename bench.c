@@ -0,0 +1,834 @@
+#define _XOPEN_SOURCE 700
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdbool.h"
+
+#include "string.h"
+#include "assert.h"
+#include "signal.h"
+#include "unistd.h"
+#include "sys/wait.h"
+#include "sys/resource.h"
+
+#include "util.h"
+#include "set.h"
+#include "worklist.h"
+#include "array.h"
+#include "graph.h"
+#include "reader.h"
+#include "wl.h"
+#include "wl_parallel.h"
+#include "thread_pool.h"
+#include "canon.h"
+#include "generator.h"
+
+/*
+ * Micro-benchmarks of the data structures used by the refinement
+ *
+ * queue : the update queue of stable_partition, splay tree (int_set) against int_worklist.
+ * Each round inserts a burst of class numbers, with repetitions as when the neighbours of a split class
+ * are marked, then pops everything in increasing order
+ *
+ * sort-<size> : sorting the hash keys of a cell of size vertices, split in about size / 8 fragments.
+ * Insertion sort, quicksort (hash_key_sort), radix sort and hash_key_sort_buffered, which picks one of them
+ *
+ * search (bench search [threads] [input ...]) : speed-up of the parallel WL search with 1, 2, 4 ... threads,
+ * on the pairs of graphs of the inputs, in matrix format as in tests/, and on generated pairs
+ * that refinement alone doesn't decide : perm2-<n>, the arcs v -> v + 1 and v -> sigma(v) of a random permutation,
+ * every vertex having in and out degree 2, against a relabeling (iso) or another such graph (non)
+ *
+ * refine (bench refine [threads] [size]) : time of the stable partition of large graphs against a relabeling,
+ * with 1, 2, 4 ... threads refining large cells, and whether the partition is the same as with one thread.
+ * sparse-<n> : 4 n random arcs, tree-<n> : random recursive tree, each vertex joined to an earlier one
+ *
+ * lists (bench lists [size] [degree]) : construction of the adjacency lists of size vertices from size * degree
+ * random arcs, one int_array per vertex. malloc : the former growth, a new buffer and a copy at each step,
+ * realloc : int_array_append, reserved : degrees counted first, csr : graph_from_edges, one block for all the lists.
+ * copy-lists-<n> : copying every list, element by element (loop) or with int_array_copy (memcpy).
+ * Best of 3 rounds
+ *
+ * suite (bench suite [scale] [seconds]) : the engines wl, wl-exact (WL_REFINE_EXACT) and canon on the families
+ * of generator.h, against a relabeling (iso) or the other graph of the family (non : the twisted CFI graph,
+ * a 2-switch of the random graph, with the same degrees and another certificate). One line of CSV per run : family,
+ * parameters, pair, engine, vertices, arcs, expected answer, answer, status (ok, wrong, timeout, crash), wall time, search nodes
+ * and peak RSS in KB. Each run is a child process, killed after seconds (default 10), so that the peak RSS is its own.
+ * scale multiplies the sizes
+ */
+
+typedef struct bench_trace {
+  int  capacity;
+  int  rounds;
+  int  burst;
+  int* values;
+} bench_trace;
+
+// Skewed towards small classes : most neighbours fall in a few large classes
+bench_trace bench_trace_new(int capacity, int rounds, int burst, uint64_t* state){
+  bench_trace t;
+  t.capacity = capacity;
+  t.rounds   = rounds;
+  t.burst    = burst;
+  t.values   = malloc((size_t) rounds * burst * sizeof(int));
+  for(long i = 0; i < (long) rounds * burst; ++i){
+    int r = random_int(state, capacity);
+    t.values[i] = random_int(state, 2) ? r : r % (1 + capacity / 64);
+  }
+  return t;
+}
+
+void bench_report(const char* name, const char* structure, long ops, double t, unsigned long checksum){
+  printf("%s %s %ld ops %.6f s %.2f ns/op checksum %lu\n", name, structure, ops, t, 1e9 * t / ops, checksum);
+}
+
+void bench_queue_set(bench_trace* tr){
+  long ops = 0;
+  unsigned long checksum = 0;
+  double t = wall_time();
+  int_set s = int_set_empty();
+  for(int r = 0; r < tr->rounds; ++r){
+    int* v = tr->values + (long) r * tr->burst;
+    for(int i = 0; i < tr->burst; ++i){
+      int_set_insert(&s, v[i]);
+    }
+    while(!int_set_is_empty(&s)){
+      checksum = checksum * 31 + int_set_delete(&s);
+      ops += 1;
+    }
+    ops += tr->burst;
+  }
+  bench_report("queue", "splay", ops, wall_time() - t, checksum);
+}
+
+void bench_queue_worklist(bench_trace* tr){
+  long ops = 0;
+  unsigned long checksum = 0;
+  double t = wall_time();
+  int_worklist w = int_worklist_new(tr->capacity);
+  for(int r = 0; r < tr->rounds; ++r){
+    int* v = tr->values + (long) r * tr->burst;
+    for(int i = 0; i < tr->burst; ++i){
+      int_worklist_insert(&w, v[i]);
+    }
+    while(!int_worklist_is_empty(&w)){
+      checksum = checksum * 31 + int_worklist_pop(&w);
+      ops += 1;
+    }
+    ops += tr->burst;
+  }
+  int_worklist_free(&w);
+  bench_report("queue", "worklist", ops, wall_time() - t, checksum);
+}
+
+// Copy of a half full queue, as done when a search node copies its partition
+void bench_copy_set(bench_trace* tr){
+  int_set s = int_set_empty();
+  for(int i = 0; i < tr->burst; ++i){
+    int_set_insert(&s, tr->values[i]);
+  }
+  unsigned long checksum = 0;
+  double t = wall_time();
+  for(int r = 0; r < tr->rounds; ++r){
+    int_set c = int_set_copy(&s);
+    checksum += int_set_delete(&c);
+    int_set_free(&c);
+  }
+  bench_report("copy", "splay", tr->rounds, wall_time() - t, checksum);
+  int_set_free(&s);
+}
+
+void bench_copy_worklist(bench_trace* tr){
+  int_worklist w = int_worklist_new(tr->capacity);
+  int_worklist c = int_worklist_new(tr->capacity);
+  for(int i = 0; i < tr->burst; ++i){
+    int_worklist_insert(&w, tr->values[i]);
+  }
+  unsigned long checksum = 0;
+  double t = wall_time();
+  for(int r = 0; r < tr->rounds; ++r){
+    int_worklist_copy_into(&c, &w);
+    checksum += int_worklist_pop(&c);
+  }
+  bench_report("copy", "worklist", tr->rounds, wall_time() - t, checksum);
+  int_worklist_free(&c);
+  int_worklist_free(&w);
+}
+
+typedef void (*bench_sort_f)(hash_key* array, int size, hash_key* buffer);
+
+void bench_sort_insertion(hash_key* array, int size, hash_key* buffer){
+  (void) buffer;
+  hash_key_insertion_sort(array, size);
+}
+
+void bench_sort_quick(hash_key* array, int size, hash_key* buffer){
+  (void) buffer;
+  hash_key_sort(array, size);
+}
+
+// Same number of keys sorted for every size
+void bench_sort(int size, int total, const char* structure, bench_sort_f sort, uint64_t* state){
+  int rounds = total / size > 0 ? total / size : 1;
+  hash_key* source = malloc(size * sizeof(hash_key));
+  hash_key* array  = malloc(size * sizeof(hash_key));
+  hash_key* buffer = malloc(size * sizeof(hash_key));
+  for(int i = 0; i < size; ++i){
+    uint64_t x = random_int(state, 1 + size / 8);
+    x = (x ^ (x >> 31)) * 0x9E3779B97F4A7C15ull;
+    source[i].hash  = x ^ (x >> 29);
+    source[i].value = i;
+  }
+  unsigned long checksum = 0;
+  double t = wall_time();
+  for(int r = 0; r < rounds; ++r){
+    memcpy(array, source, size * sizeof(hash_key));
+    sort(array, size, buffer);
+    checksum = checksum * 31 + array[r % size].hash;
+  }
+  t = wall_time() - t;
+  char name[32];
+  snprintf(name, sizeof(name), "sort-%d", size);
+  bench_report(name, structure, (long) rounds * size, t, checksum);
+  free(source);
+  free(array);
+  free(buffer);
+}
+
+void bench_search_pair(const char* name, graph* g[2], int max_threads){
+  double base = 0.;
+  for(int threads = 1; threads <= max_threads; threads *= 2){
+    wl_workspace ws = wl_workspace_new();
+    double t = wall_time();
+    int_array iso = threads == 1 ? graph_isomorphism_WL_workspace(&ws, g, NULL)
+                                 : graph_isomorphism_WL_parallel(&ws, g, NULL, threads);
+    t = wall_time() - t;
+    if(threads == 1){
+      base = t;
+    }
+    printf("search %s %d threads %ld nodes %.6f s speedup %.2f %s\n",
+           name, threads, ws.stats.nodes, t, base / t, iso.size != 0 ? "oui" : "non");
+    int_array_free(&iso);
+    wl_workspace_free(&ws);
+  }
+}
+
+// Arcs v -> v + 1 and v -> sigma(v), sigma having no v such that sigma(v) is v or v + 1
+graph bench_perm2(int size, uint64_t* state){
+  int_array sigma = int_array_empty();
+  bool valid = false;
+  while(!valid){
+    int_array_free(&sigma);
+    sigma = random_isomorphism(size, state);
+    valid = true;
+    for(int v = 0; v < size && valid; ++v){
+      valid = sigma.array[v] != v && sigma.array[v] != (v + 1) % size;
+    }
+  }
+  int_array src = int_array_new(2 * size);
+  int_array dst = int_array_new(2 * size);
+  for(int v = 0; v < size; ++v){
+    src.array[2 * v]     = v;
+    dst.array[2 * v]     = (v + 1) % size;
+    src.array[2 * v + 1] = v;
+    dst.array[2 * v + 1] = sigma.array[v];
+  }
+  graph g = graph_from_edges(size, 2 * size, src.array, dst.array, NULL);
+  int_array_free(&sigma);
+  int_array_free(&src);
+  int_array_free(&dst);
+  return g;
+}
+
+int bench_search(int argc, char** argv, uint64_t* state){
+  int max_threads = argc > 0 ? atoi(argv[0]) : 8;
+  if(max_threads <= 0){
+    fprintf(stderr, "usage : bench search [threads] [input ...]\n");
+    return 1;
+  }
+  for(int i = 1; i < argc; ++i){
+    FILE* f = fopen(argv[i], "r");
+    if(f == NULL){
+      fprintf(stderr, "cannot open %s\n", argv[i]);
+      return 1;
+    }
+    reader r = reader_new(f);
+    graph g[2];
+    TWICE(k) g[k] = graph_read_format(&r, GRAPH_FORMAT_MATRIX);
+    reader_free(&r);
+    fclose(f);
+    graph* g_[2] = { &g[0], &g[1] };
+    if(!graph_is_empty(&g[0]) && !graph_is_empty(&g[1])){
+      const char* name = strrchr(argv[i], '/');
+      bench_search_pair(name != NULL ? name + 1 : argv[i], g_, max_threads);
+    }
+    TWICE(k) graph_free(&g[k]);
+  }
+  for(int size = 500; size <= 2000; size *= 2){
+    graph g[3];
+    g[0] = bench_perm2(size, state);
+    int_array sigma = random_isomorphism(size, state);
+    g[1] = graph_apply_isomorphism(&g[0], &sigma);
+    int_array_free(&sigma);
+    g[2] = bench_perm2(size, state);
+    char name[32];
+    snprintf(name, sizeof(name), "perm2-%d-iso", size);
+    graph* iso[2] = { &g[0], &g[1] };
+    bench_search_pair(name, iso, max_threads);
+    snprintf(name, sizeof(name), "perm2-%d-non", size);
+    graph* non[2] = { &g[0], &g[2] };
+    bench_search_pair(name, non, max_threads);
+    for(int k = 0; k < 3; ++k){
+      graph_free(&g[k]);
+    }
+  }
+  return 0;
+}
+
+// Random arcs, duplicates removed
+graph bench_sparse(int size, int nedge, uint64_t* state){
+  int_array src = int_array_new(nedge);
+  int_array dst = int_array_new(nedge);
+  for(int i = 0; i < nedge; ++i){
+    src.array[i] = random_int(state, size);
+    dst.array[i] = random_int(state, size);
+  }
+  graph g = graph_from_edges(size, nedge, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
+  return g;
+}
+
+// Each vertex but the first one is joined to a random earlier vertex, in both directions
+graph bench_tree(int size, uint64_t* state){
+  int nedge = size > 0 ? 2 * (size - 1) : 0;
+  int_array src = int_array_new(nedge);
+  int_array dst = int_array_new(nedge);
+  for(int v = 1; v < size; ++v){
+    int u = random_int(state, v);
+    src.array[2 * (v - 1)]     = u;
+    dst.array[2 * (v - 1)]     = v;
+    src.array[2 * (v - 1) + 1] = v;
+    dst.array[2 * (v - 1) + 1] = u;
+  }
+  graph g = graph_from_edges(size, nedge, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
+  return g;
+}
+
+void bench_refine_pair(const char* name, graph* g0, int max_threads, uint64_t* state){
+  int_array sigma = random_isomorphism(g0->size, state);
+  graph g1 = graph_apply_isomorphism(g0, &sigma);
+  int_array_free(&sigma);
+  graph* g[2] = { g0, &g1 };
+  graph rg_[2];
+  TWICE(k) rg_[k] = graph_reverse(g[k]);
+  graph* rg[2] = { &rg_[0], &rg_[1] };
+  int_array reference[2] = { int_array_empty(), int_array_empty() };
+  double base = 0.;
+  for(int threads = 1; threads <= max_threads; threads *= 2){
+    thread_pool* pool = threads > 1 ? thread_pool_new(threads) : NULL;
+    if(threads > 1 && pool == NULL){
+      fprintf(stderr, "cannot create %d threads\n", threads);
+      break;
+    }
+    wl_partition p = wl_partition_empty();
+    p.pool = pool;
+    double t = wall_time();
+    bool valid = wl_graph_degree_partition_into(g, &p) && stable_partition(g, rg, &p);
+    t = wall_time() - t;
+    bool same = true;
+    if(threads == 1){
+      base = t;
+      TWICE(k) reference[k] = int_array_copy(&p.perm[k]);
+    }else{
+      TWICE(k) same = same && memcmp(reference[k].array, p.perm[k].array, p.size * sizeof(int)) == 0;
+    }
+    printf("refine %s %d threads %d cells %.6f s speedup %.2f %s%s\n",
+           name, threads, p.cells, t, base / t, same ? "same" : "different", valid ? "" : " invalid");
+    wl_partition_free(&p);
+    thread_pool_free(pool);
+  }
+  TWICE(k){
+    int_array_free(&reference[k]);
+    graph_free(&rg_[k]);
+  }
+  graph_free(&g1);
+}
+
+int bench_refine(int argc, char** argv, uint64_t* state){
+  int max_threads = argc > 0 ? atoi(argv[0]) : 64;
+  int size        = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  if(max_threads <= 0 || size <= 0){
+    fprintf(stderr, "usage : bench refine [threads] [size]\n");
+    return 1;
+  }
+  char name[32];
+  graph g = bench_sparse(size, 4 * size, state);
+  snprintf(name, sizeof(name), "sparse-%d", size);
+  bench_refine_pair(name, &g, max_threads, state);
+  graph_free(&g);
+  g = bench_tree(size, state);
+  snprintf(name, sizeof(name), "tree-%d", size);
+  bench_refine_pair(name, &g, max_threads, state);
+  graph_free(&g);
+  return 0;
+}
+
+// Growth of int_array_append before vectors used realloc
+void bench_append_malloc(int_array* array, int value){
+  if(array->size == array->bufferSize){
+    int bufferSize = (3 * array->bufferSize) / 2 + 1;
+    int* a = malloc(bufferSize * sizeof(int));
+    for(int i = 0; i < array->size; ++i){
+      a[i] = array->array[i];
+    }
+    free(array->array);
+    array->array      = a;
+    array->bufferSize = bufferSize;
+  }
+  array->array[array->size] = value;
+  array->size += 1;
+}
+
+enum { BENCH_LISTS_MALLOC, BENCH_LISTS_REALLOC, BENCH_LISTS_RESERVED, BENCH_LISTS_CSR, BENCH_LISTS_MODES };
+
+unsigned long bench_lists_checksum(int_array_array* lists){
+  unsigned long checksum = 0;
+  for(int v = 0; v < lists->size; ++v){
+    int_array* l = &lists->array[v];
+    checksum = checksum * 31 + l->size + (l->size != 0 ? l->array[l->size - 1] : 0);
+  }
+  return checksum;
+}
+
+// Time of the construction of the lists, which are returned in lists but for csr
+double bench_lists_build(int size, int nedge, const int* src, const int* dst, int mode, int_array_array* lists){
+  double t = wall_time();
+  if(mode == BENCH_LISTS_CSR){
+    graph g = graph_from_edges(size, nedge, src, dst, NULL);
+    t = wall_time() - t;
+    graph_free(&g);
+    *lists = int_array_array_empty();
+    return t;
+  }
+  *lists = int_array_array_new(size);
+  if(mode == BENCH_LISTS_RESERVED){
+    int_array degree = int_array_new(size);
+    memset(degree.array, 0, size * sizeof(int));
+    for(int e = 0; e < nedge; ++e){
+      degree.array[src[e]] += 1;
+    }
+    for(int v = 0; v < size; ++v){
+      int_array_reserve(&lists->array[v], degree.array[v]);
+    }
+    int_array_free(&degree);
+  }
+  for(int e = 0; e < nedge; ++e){
+    if(mode == BENCH_LISTS_MALLOC){
+      bench_append_malloc(&lists->array[src[e]], dst[e]);
+    }else{
+      int_array_append(&lists->array[src[e]], dst[e]);
+    }
+  }
+  return wall_time() - t;
+}
+
+// Time of the copy of every list, element by element or with int_array_copy
+double bench_lists_copy(int_array_array* lists, bool memcpy, unsigned long* checksum){
+  double t = wall_time();
+  int_array_array copy = int_array_array_new(lists->size);
+  for(int v = 0; v < lists->size; ++v){
+    int_array* l = &lists->array[v];
+    if(memcpy){
+      copy.array[v] = int_array_copy(l);
+    }else{
+      copy.array[v] = int_array_new(l->size);
+      for(int i = 0; i < l->size; ++i){
+        copy.array[v].array[i] = l->array[i];
+      }
+    }
+  }
+  t = wall_time() - t;
+  *checksum = bench_lists_checksum(&copy);
+  int_array_array_free(&copy);
+  return t;
+}
+
+// The state of the heap favours the first runs : modes take turns, the best of rounds is kept
+int bench_lists(int argc, char** argv, uint64_t* state){
+  int size   = argc > 0 ? atoi(argv[0]) : 1 << 20;
+  int degree = argc > 1 ? atoi(argv[1]) : 8;
+  int rounds = 3;
+  if(size <= 0 || degree <= 0 || (long) size * degree > (1 << 30)){
+    fprintf(stderr, "usage : bench lists [size] [degree]\n");
+    return 1;
+  }
+  int nedge = size * degree;
+  int_array src = int_array_new(nedge);
+  int_array dst = int_array_new(nedge);
+  for(int e = 0; e < nedge; ++e){
+    src.array[e] = random_int(state, size);
+    dst.array[e] = random_int(state, size);
+  }
+  double best[BENCH_LISTS_MODES + 2];
+  unsigned long checksum[BENCH_LISTS_MODES + 2];
+  for(int k = 0; k < BENCH_LISTS_MODES + 2; ++k){
+    best[k] = -1.;
+    checksum[k] = 0;
+  }
+  for(int r = 0; r < rounds; ++r){
+    for(int mode = 0; mode < BENCH_LISTS_MODES; ++mode){
+      int_array_array lists;
+      double t = bench_lists_build(size, nedge, src.array, dst.array, mode, &lists);
+      checksum[mode] = mode == BENCH_LISTS_CSR ? (unsigned long) nedge : bench_lists_checksum(&lists);
+      if(mode == BENCH_LISTS_REALLOC){
+        TWICE(k){
+          double c = bench_lists_copy(&lists, k == 1, &checksum[BENCH_LISTS_MODES + k]);
+          if(best[BENCH_LISTS_MODES + k] < 0 || c < best[BENCH_LISTS_MODES + k]){
+            best[BENCH_LISTS_MODES + k] = c;
+          }
+        }
+      }
+      int_array_array_free(&lists);
+      if(best[mode] < 0 || t < best[mode]){
+        best[mode] = t;
+      }
+    }
+  }
+  static const char* structures[] = { "malloc", "realloc", "reserved", "csr", "loop", "memcpy" };
+  char name[32];
+  for(int k = 0; k < BENCH_LISTS_MODES + 2; ++k){
+    snprintf(name, sizeof(name), k < BENCH_LISTS_MODES ? "lists-%d" : "copy-lists-%d", size);
+    bench_report(name, structures[k], nedge, best[k], checksum[k]);
+  }
+  int_array_free(&src);
+  int_array_free(&dst);
+  return 0;
+}
+
+typedef graph (*bench_family_f)(int size, bool other, uint64_t* state);
+
+// g with the edges u v and x y replaced by u y and x v : a 2-switch, which keeps the degrees
+graph bench_suite_switch(graph* g, int u, int v, int x, int y){
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  for(int i = 0; i < g->size; ++i){
+    int* nb = graph_neighbours(g, i);
+    for(int k = 0; k < graph_degree(g, i); ++k){
+      int j = nb[k];
+      if(!((i == u && j == v) || (i == v && j == u) || (i == x && j == y) || (i == y && j == x))){
+        int_array_append(&src, i);
+        int_array_append(&dst, j);
+      }
+    }
+  }
+  int a[4] = { u, y, x, v };
+  for(int k = 0; k < 4; ++k){
+    int_array_append(&src, a[k]);
+    int_array_append(&dst, a[k ^ 1]);
+  }
+  graph h = graph_from_edges(g->size, src.size, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
+  return h;
+}
+
+/*
+ * The other graph of the random families : the first 2-switch of g, in the order of the vertices, whose certificate
+ * differs from the one of g. The degrees are the same, refinement has to tell them apart.
+ * graph_empty() if every 2-switch gives a graph isomorphic to g
+ */
+graph bench_suite_switched(graph g, bool other){
+  if(!other){
+    return g;
+  }
+  canon_form c = graph_canonical_form(&g);
+  graph h = graph_empty();
+  for(int u = 0; u < g.size && graph_is_empty(&h); ++u){
+    int* nu = graph_neighbours(&g, u);
+    for(int k = 0; k < graph_degree(&g, u) && graph_is_empty(&h); ++k){
+      int v = nu[k];
+      for(int x = u + 1; x < g.size && graph_is_empty(&h); ++x){
+        int* nx = graph_neighbours(&g, x);
+        for(int l = 0; l < graph_degree(&g, x) && graph_is_empty(&h); ++l){
+          int y = nx[l];
+          if(x == v || y == u || y == v || graph_has_edge(&g, u, y) || graph_has_edge(&g, x, v)){
+            continue;
+          }
+          h = bench_suite_switch(&g, u, v, x, y);
+          canon_form d = graph_canonical_form(&h);
+          if(canon_form_equal(&c, &d)){
+            graph_free(&h);
+            h = graph_empty();
+          }
+          canon_form_free(&d);
+        }
+      }
+    }
+  }
+  canon_form_free(&c);
+  graph_free(&g);
+  return h;
+}
+
+graph bench_suite_gnp(int size, bool other, uint64_t* state){
+  return bench_suite_switched(graph_gnp(size, 8. / size, state), other);
+}
+
+graph bench_suite_regular(int size, bool other, uint64_t* state){
+  return bench_suite_switched(graph_random_regular(size, 3, state), other);
+}
+
+graph bench_suite_grid(int size, bool other, uint64_t* state){
+  (void) other;
+  (void) state;
+  return graph_grid(size, size, false);
+}
+
+graph bench_suite_torus(int size, bool other, uint64_t* state){
+  (void) other;
+  (void) state;
+  return graph_grid(size, size, true);
+}
+
+graph bench_suite_paley(int size, bool other, uint64_t* state){
+  (void) other;
+  (void) state;
+  return graph_paley(size);
+}
+
+// Same random 3-regular base for both graphs, twisted for the other one
+graph bench_suite_cfi(int size, bool other, uint64_t* state){
+  uint64_t base_state = *state;
+  graph base = graph_random_regular(size, 3, &base_state);
+  graph g = graph_cfi(&base, other);
+  graph_free(&base);
+  return g;
+}
+
+graph bench_suite_cfi_ladder(int size, bool other, uint64_t* state){
+  (void) state;
+  return graph_cfi_ladder(size, other);
+}
+
+graph bench_suite_tree(int size, bool other, uint64_t* state){
+  return bench_suite_switched(graph_random_tree(size, state), other);
+}
+
+typedef struct bench_family {
+  const char*    name;
+  bench_family_f make;
+  const char*    parameter;
+  int            size;      // at scale 1
+  bool           prime;     // size rounded up to a prime = 1 mod 4
+  bool           other;     // has another graph, not isomorphic to the first one
+} bench_family;
+
+const bench_family bench_families[] = {
+  { "gnp",        bench_suite_gnp,        "n",     1000,  false, true  },
+  { "regular",    bench_suite_regular,    "n",     1000,  false, true  },
+  { "grid",       bench_suite_grid,       "side",  30,    false, false },
+  { "torus",      bench_suite_torus,      "side",  30,    false, false },
+  { "paley",      bench_suite_paley,      "q",     100,   true,  false },
+  { "cfi",        bench_suite_cfi,        "base",  20,    false, true  },
+  { "cfi-ladder", bench_suite_cfi_ladder, "rungs", 10,    false, true  },
+  { "tree",       bench_suite_tree,       "n",     10000, false, true  },
+};
+
+#define BENCH_ENGINE_WL       0
+#define BENCH_ENGINE_WL_EXACT 1
+#define BENCH_ENGINE_CANON    2
+
+const char* bench_engines[] = { "wl", "wl-exact", "canon" };
+
+int bench_paley_prime(int q){
+  while(true){
+    if(q % 4 == 1){
+      bool prime = q > 1;
+      for(int d = 2; d * d <= q && prime; ++d){
+        prime = q % d != 0;
+      }
+      if(prime){
+        return q;
+      }
+    }
+    q += 1;
+  }
+}
+
+/*
+ * Same seed for every engine and for both graphs : g[1] is a relabeling of g[0] or of the other graph.
+ * Returns false, with empty graphs, if the family has no other graph at this size
+ */
+bool bench_suite_pair(const bench_family* f, int size, bool non, graph g[2]){
+  uint64_t state = 42;
+  uint64_t other_state = state;
+  g[0] = f->make(size, false, &state);
+  graph h = non ? f->make(size, true, &other_state) : g[0];
+  if(graph_is_empty(&h)){
+    graph_free(&g[0]);
+    g[1] = graph_empty();
+    return false;
+  }
+  int_array sigma = random_isomorphism(h.size, &state);
+  g[1] = graph_apply_isomorphism(&h, &sigma);
+  int_array_free(&sigma);
+  if(non){
+    graph_free(&h);
+  }
+  return true;
+}
+
+bool bench_suite_check(graph g[2], int_array* iso){
+  if(g[0].size != g[1].size || graph_edge_count(&g[0]) != graph_edge_count(&g[1]) || iso->size != g[0].size){
+    return false;
+  }
+  for(int i = 0; i < g[0].size; ++i){
+    int* nb = graph_neighbours(&g[0], i);
+    for(int k = 0; k < graph_degree(&g[0], i); ++k){
+      if(!graph_has_edge(&g[1], iso->array[i], iso->array[nb[k]])){
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// In the child process : solves the pair, inherited from the parent, prints its line and exits
+void bench_suite_child(const bench_family* f, const char* parameters, graph g[2], bool non, int engine, int seconds){
+  alarm(seconds);
+  // Undirected : every graph is its own reverse
+  graph* g_[2] = { &g[0], &g[1] };
+  wl_workspace ws = wl_workspace_new();
+  if(engine == BENCH_ENGINE_WL_EXACT){
+    ws.p.refine = WL_REFINE_EXACT;
+  }
+  long nodes = 0;
+  double t = wall_time();
+  TWICE(i) graph_build_matrix(&g[i], GRAPH_MATRIX_BUDGET);
+  int_array iso;
+  if(engine == BENCH_ENGINE_CANON){
+    canon_form c[2];
+    TWICE(i){
+      canon_stats st;
+      c[i] = graph_canonical_form_workspace(&ws, &g[i], &g[i], &st);
+      nodes += st.nodes;
+    }
+    iso = canon_form_isomorphism(&c[0], &c[1]);
+    TWICE(i) canon_form_free(&c[i]);
+  }else{
+    iso = graph_isomorphism_WL_workspace(&ws, g_, g_);
+    nodes = ws.stats.nodes;
+  }
+  t = wall_time() - t;
+  const char* expected = non ? "non" : "oui";
+  const char* answer = iso.size != 0 ? "oui" : "non";
+  bool ok = strcmp(expected, answer) == 0 && (iso.size == 0 || bench_suite_check(g, &iso));
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%s,%s,%s,%s,%d,%d,%s,%s,%s,%.6f,%ld,%ld\n", f->name, parameters, non ? "non" : "iso", bench_engines[engine],
+         g[0].size, graph_edge_count(&g[0]), expected, answer, ok ? "ok" : "wrong", t, nodes, usage.ru_maxrss);
+  fflush(stdout);
+  _exit(0);
+}
+
+void bench_suite_run(const bench_family* f, int size, graph g[2], bool non, int engine, int seconds){
+  char parameters[32];
+  snprintf(parameters, sizeof(parameters), "%s=%d", f->parameter, size);
+  int vertices = g[0].size, arcs = graph_edge_count(&g[0]);
+  fflush(stdout);
+  double t = wall_time();
+  pid_t pid = fork();
+  if(pid < 0){
+    perror("fork");
+    return;
+  }
+  if(pid == 0){
+    bench_suite_child(f, parameters, g, non, engine, seconds);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  t = wall_time() - t;
+  if(WIFEXITED(status) && WEXITSTATUS(status) == 0){
+    return;
+  }
+  bool timeout = WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM;
+  printf("%s,%s,%s,%s,%d,%d,%s,-,%s,%.6f,-,-\n", f->name, parameters, non ? "non" : "iso", bench_engines[engine],
+         vertices, arcs, non ? "non" : "oui", timeout ? "timeout" : "crash", t);
+}
+
+int bench_suite(int argc, char** argv){
+  int scale   = argc > 0 ? atoi(argv[0]) : 1;
+  int seconds = argc > 1 ? atoi(argv[1]) : 10;
+  if(scale <= 0 || seconds <= 0){
+    fprintf(stderr, "usage : bench suite [scale] [seconds]\n");
+    return 1;
+  }
+  printf("family,parameters,pair,engine,vertices,arcs,expected,answer,status,seconds,nodes,peak_rss_kb\n");
+  for(size_t k = 0; k < sizeof(bench_families) / sizeof(bench_families[0]); ++k){
+    const bench_family* f = &bench_families[k];
+    int size = f->size * scale;
+    if(f->prime){
+      size = bench_paley_prime(size);
+    }
+    TWICE(non){
+      if(non && !f->other){
+        continue;
+      }
+      // Built once, the children run on copies
+      graph g[2];
+      if(!bench_suite_pair(f, size, non, g)){
+        fprintf(stderr, "%s : no other graph at size %d\n", f->name, size);
+        continue;
+      }
+      for(int engine = 0; engine < 3; ++engine){
+        bench_suite_run(f, size, g, non, engine, seconds);
+      }
+      TWICE(i) graph_free(&g[i]);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv){
+  uint64_t state = 42;
+  if(argc > 1 && strcmp(argv[1], "search") == 0){
+    return bench_search(argc - 2, argv + 2, &state);
+  }
+  if(argc > 1 && strcmp(argv[1], "refine") == 0){
+    return bench_refine(argc - 2, argv + 2, &state);
+  }
+  if(argc > 1 && strcmp(argv[1], "lists") == 0){
+    return bench_lists(argc - 2, argv + 2, &state);
+  }
+  if(argc > 1 && strcmp(argv[1], "suite") == 0){
+    return bench_suite(argc - 2, argv + 2);
+  }
+  int capacity = argc > 1 ? atoi(argv[1]) : 100000;
+  int rounds   = argc > 2 ? atoi(argv[2]) : 2000;
+  int burst    = argc > 3 ? atoi(argv[3]) : 1000;
+  if(capacity <= 0 || rounds <= 0 || burst <= 0){
+    fprintf(stderr, "usage : %s [capacity rounds burst]\n", argv[0]);
+    fprintf(stderr, "        %s search [threads] [input ...]\n", argv[0]);
+    fprintf(stderr, "        %s refine [threads] [size]\n", argv[0]);
+    fprintf(stderr, "        %s lists [size] [degree]\n", argv[0]);
+    fprintf(stderr, "        %s suite [scale] [seconds]\n", argv[0]);
+    return 1;
+  }
+  bench_trace tr = bench_trace_new(capacity, rounds, burst, &state);
+  bench_queue_set(&tr);
+  bench_queue_worklist(&tr);
+  bench_copy_set(&tr);
+  bench_copy_worklist(&tr);
+  free(tr.values);
+  for(int size = 4; size <= (1 << 20); size *= 4){
+    if(size <= 256){
+      bench_sort(size, 1 << 22, "insertion", bench_sort_insertion, &state);
+    }
+    bench_sort(size, 1 << 22, "quick", bench_sort_quick, &state);
+    bench_sort(size, 1 << 22, "radix", hash_key_radix_sort, &state);
+    bench_sort(size, 1 << 22, "buffered", hash_key_sort_buffered, &state);
+  }
+  return 0;
+}
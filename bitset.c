@@ -0,0 +1,50 @@
+#include "bitset.h"
+
+bitset bitset_empty(){
+  bitset b;
+  b.size  = 0;
+  b.words = 0;
+  b.array = NULL;
+  return b;
+}
+
+bitset bitset_new(int size){
+  bitset b;
+  b.size  = size;
+  b.words = BITSET_WORDS(size);
+  b.array = calloc(b.words > 0 ? b.words : 1, sizeof(uint64_t));
+  return b;
+}
+
+void bitset_free(bitset* b){
+  assert(b != NULL);
+  if(b->array){
+    free(b->array);
+  }
+}
+
+bitset bitset_copy(bitset* b){
+  assert(b != NULL);
+  bitset c = bitset_new(b->size);
+  memcpy(c.array, b->array, b->words * sizeof(uint64_t));
+  return c;
+}
+
+void bitset_clear_all(bitset* b){
+  assert(b != NULL);
+  memset(b->array, 0, b->words * sizeof(uint64_t));
+}
+
+bool bitset_equal(bitset* a, bitset* b){
+  assert(a != NULL && b != NULL);
+  return a->size == b->size && memcmp(a->array, b->array, a->words * sizeof(uint64_t)) == 0;
+}
+
+int bitset_count(bitset* b){
+  assert(b != NULL);
+  int c = 0;
+  for(int i = 0; i < b->words; ++i){
+    c += __builtin_popcountll(b->array[i]);
+  }
+  return c;
+}
@@ -0,0 +1,43 @@
+#ifndef ALGO_GISO_BITSET_H
+#define ALGO_GISO_BITSET_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "string.h"
+#include "assert.h"
+
+// bitset : 64 bits per word
+
+typedef struct bitset {
+  int       size;
+  int       words;
+  uint64_t* array;
+} bitset;
+
+#define BITSET_WORDS(size) (((size) + 63) >> 6)
+
+bitset bitset_empty();
+bitset bitset_new(int size);
+void bitset_free(bitset* b);
+bitset bitset_copy(bitset* b);
+void bitset_clear_all(bitset* b);
+bool bitset_equal(bitset* a, bitset* b);
+int bitset_count(bitset* b);
+
+static inline bool bitset_get(const bitset* b, int i){
+  assert(i >= 0 && i < b->size);
+  return (b->array[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void bitset_set(bitset* b, int i){
+  assert(i >= 0 && i < b->size);
+  b->array[i >> 6] |= UINT64_C(1) << (i & 63);
+}
+
+static inline void bitset_clear(bitset* b, int i){
+  assert(i >= 0 && i < b->size);
+  b->array[i >> 6] &= ~(UINT64_C(1) << (i & 63));
+}
+
+#endif
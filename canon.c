@@ -0,0 +1,369 @@
+#include "canon.h"
+
+#include "string.h"
+#include "assert.h"
+
+#include "util.h"
+
+canon_form canon_form_empty(){
+  canon_form c;
+  c.labeling    = int_array_empty();
+  c.certificate = graph_empty();
+  c.hash        = 0;
+  return c;
+}
+
+bool canon_form_is_empty(canon_form* c){
+  assert(c != NULL);
+  return graph_is_empty(&c->certificate);
+}
+
+void canon_form_free(canon_form* c){
+  assert(c != NULL);
+  int_array_free(&c->labeling);
+  graph_free(&c->certificate);
+}
+
+bool canon_form_equal(canon_form* a, canon_form* b){
+  assert(a != NULL && b != NULL);
+  return a->hash == b->hash && graph_compare(&a->certificate, &b->certificate) == 0;
+}
+
+int_array canon_form_isomorphism(canon_form* a, canon_form* b){
+  assert(a != NULL && b != NULL);
+  if(!canon_form_equal(a, b)){
+    return int_array_empty();
+  }
+  int n = a->labeling.size;
+  int_array inverse = int_array_new(n);
+  for(int v = 0; v < n; ++v){
+    inverse.array[b->labeling.array[v]] = v;
+  }
+  int_array iso = int_array_new(n);
+  for(int v = 0; v < n; ++v){
+    iso.array[v] = inverse.array[a->labeling.array[v]];
+  }
+  int_array_free(&inverse);
+  return iso;
+}
+
+/*
+ * canon_search
+ *
+ * State of the search : the trace of the current path, the best leaf found so far and the first leaf,
+ * kept once a better one replaces it. Paths are the vertices individualized down to the leaf
+ */
+
+typedef struct canon_search {
+  graph*        g[2];
+  graph*        rg[2];
+  wl_workspace* ws;
+  int_array   trace;
+  int_array   best_trace;
+  int_array   best_path;
+  canon_form  best;
+  int_array   first_trace;
+  int_array   first_path;
+  canon_form  first;
+  int_array   labeling;
+  canon_stats stats;
+} canon_search;
+
+// Cells of [begin, end) : numbers, sizes and hashes
+unsigned canon_trace_cells(wl_partition* p, unsigned h, int begin, int end){
+  for(int i = begin; i < end; i = wl_partition_next(p, i)){
+    uint64_t hash = wl_partition_hash(p, 0, p->perm[0].array[i]);
+    unsigned x = i * 0x9E3779B1u
+      ^ p->cell_size.array[i] * 0x85EBCA6Bu
+      ^ (unsigned) (hash ^ (hash >> 32));
+    h = int_rotate(h) ^ (x * 0xC2B2AE35u);
+  }
+  return h;
+}
+
+/*
+ * Invariant of a stable partition : cell numbers, sizes and hashes.
+ * Below the root, the trace of the parent followed by the cells which the node split, in the order of the trail :
+ * O(cells split) instead of O(cells) at each node
+ */
+int canon_trace(canon_search* s, wl_partition* p, int depth){
+  unsigned h = p->cells;
+  if(depth == 0){
+    return canon_trace_cells(p, h, 0, p->size);
+  }
+  h = int_rotate(h) ^ (unsigned) s->trace.array[depth - 1];
+  int t = p->trail_size;
+  while(p->trail[t - 1].kind != WL_TRAIL_MARK){
+    t -= 1;
+  }
+  for(; t < p->trail_size; ++t){
+    wl_trail_entry* e = &p->trail[t];
+    if(e->kind == WL_TRAIL_SPLIT || e->kind == WL_TRAIL_INDIVIDUALIZE){
+      h = canon_trace_cells(p, int_rotate(h) ^ (unsigned) e->kind, e->a, e->a + e->b);
+    }
+  }
+  return h;
+}
+
+// Compares the trace of the current path with the trace of the best leaf, on depths [0, depth]
+int canon_compare_trace(canon_search* s, int depth){
+  for(int d = 0; d <= depth; ++d){
+    if(d >= s->best_trace.size){
+      return 1;
+    }
+    if(s->trace.array[d] != s->best_trace.array[d]){
+      return (unsigned) s->trace.array[d] < (unsigned) s->best_trace.array[d] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Leaf with the same trace and certificate as the leaf of (form, path, trace) : labeling followed by the inverse
+ * of the labeling of that leaf is an automorphism, which fixes the common prefix of both paths.
+ * It maps the subtree of the child of their deepest common node on the other path, already searched,
+ * to the one of the current path : the search resumes at that common node.
+ * Returns its depth, -1 if the leaves aren't equivalent
+ */
+int canon_equivalent(canon_search* s, wl_partition* p, int depth, graph* certificate,
+                     canon_form* form, int_array* path, int_array* trace){
+  if(canon_form_is_empty(form) || trace->size != depth + 1
+     || memcmp(trace->array, s->trace.array, (depth + 1) * sizeof(int)) != 0
+     || graph_compare(certificate, &form->certificate) != 0){
+    return -1;
+  }
+  arena_mark m = arena_get_mark(&p->arena);
+  int_array inverse = int_array_arena(&p->arena, p->size);
+  for(int v = 0; v < p->size; ++v){
+    inverse.array[form->labeling.array[v]] = v;
+  }
+  // The labeling is recomputed at each leaf
+  for(int v = 0; v < p->size; ++v){
+    s->labeling.array[v] = inverse.array[s->labeling.array[v]];
+  }
+  if(wl_orbits_add(&s->ws->orbits, depth, &s->labeling)){
+    s->stats.automorphisms += 1;
+  }
+  arena_release(&p->arena, m);
+  const int* current = s->ws->orbits.path.array;
+  int k = 0;
+  while(k < depth - 1 && current[k] == path->array[k]){
+    k += 1;
+  }
+  return k;
+}
+
+/*
+ * Discrete partition : labels are positions
+ * Returns the depth of the node where the search resumes, the parent unless the leaf is equivalent to the first
+ * or the best one
+ */
+int canon_leaf(canon_search* s, wl_partition* p, int depth, int cmp){
+  s->stats.leaves += 1;
+  for(int i = 0; i < p->size; ++i){
+    s->labeling.array[p->perm[0].array[i]] = i;
+  }
+  graph certificate = graph_apply_isomorphism(s->g[0], &s->labeling);
+  if(canon_form_is_empty(&s->best) || cmp < 0 || (cmp == 0 && depth + 1 < s->best_trace.size)
+     || (cmp == 0 && graph_compare(&certificate, &s->best.certificate) < 0)){
+    if(canon_form_is_empty(&s->first) && !canon_form_is_empty(&s->best)){
+      SWAP(canon_form, s->first, s->best);
+      SWAP(int_array, s->first_trace, s->best_trace);
+      SWAP(int_array, s->first_path, s->best_path);
+    }
+    canon_form_free(&s->best);
+    s->best.labeling    = int_array_copy(&s->labeling);
+    s->best.certificate = certificate;
+    int_array_free(&s->best_trace);
+    s->best_trace       = int_array_copy(&s->trace);
+    s->best_trace.size  = depth + 1;
+    int_array_free(&s->best_path);
+    s->best_path        = int_array_copy(&s->ws->orbits.path);
+    s->best_path.size   = depth;
+    return depth - 1;
+  }
+  int k = canon_equivalent(s, p, depth, &certificate, &s->best, &s->best_path, &s->best_trace);
+  if(k < 0){
+    k = canon_equivalent(s, p, depth, &certificate, &s->first, &s->first_path, &s->first_trace);
+  }
+  graph_free(&certificate);
+  if(k < 0){
+    return depth - 1;
+  }
+  if(k < depth - 1){
+    s->stats.backjumps += 1;
+  }
+  return k;
+}
+
+/*
+ * Enters the node at depth below the last individualization, pushing its frame on the stack of the workspace
+ * unless it is a leaf or pruned
+ * cmp : comparison of the trace of the path to p (excluded) with the best one, -1 (smaller) or 0 (equal)
+ * from : position before which all the cells are singletons
+ * Returns depth if the frame was pushed, otherwise the depth of the node where the search resumes,
+ * depth - 1 once the node is done, -1 once the budget of nodes is exceeded
+ */
+int canon_enter(canon_search* s, wl_partition* p, int depth, int cmp, int from){
+  s->stats.nodes += 1;
+  if(s->ws->budget > 0 && s->stats.nodes > s->ws->budget){
+    return -1;
+  }
+  if(depth > s->stats.depth){
+    s->stats.depth = depth;
+  }
+  bool valid = stable_partition(s->g, s->rg, p);
+  assert(valid);
+  (void) valid;
+
+  while(s->trace.size <= depth){
+    int_array_append(&s->trace, 0);
+  }
+  s->trace.array[depth] = canon_trace(s, p, depth);
+  if(!canon_form_is_empty(&s->best) && cmp == 0){
+    if(depth >= s->best_trace.size
+       || (unsigned) s->trace.array[depth] > (unsigned) s->best_trace.array[depth]){
+      s->stats.pruned += 1;
+      return depth - 1;
+    }
+    if(s->trace.array[depth] != s->best_trace.array[depth]){
+      cmp = -1;
+    }
+  }
+
+  int i = wl_target_cell_from(s->g, s->rg, p, s->ws->target, &s->ws->count, from);
+  if(i == p->size){
+    return canon_leaf(s, p, depth, cmp);
+  }
+  wl_frame* f = wl_frame_array_push(&s->ws->frames);
+  f->depth      = depth;
+  f->c          = i;
+  f->size       = p->cell_size.array[i];
+  f->candidates = p->perm[0].array + i;
+  f->end        = f->size;
+  f->j          = -1;
+  f->cmp        = cmp;
+  return depth;
+}
+
+/*
+ * Individualizes the next child of frame f which is not in the orbit of an explored one, under the automorphisms
+ * fixing the path : false if there is none left.
+ * The trail restores the target cell in the same order after each child
+ */
+bool canon_next(canon_search* s, wl_partition* p, wl_frame* f){
+  wl_orbits* o = &s->ws->orbits;
+  while(f->j + 1 < f->end){
+    f->j += 1;
+    int v = p->perm[0].array[f->c + f->j];
+    if(f->j > 0 && o->automorphisms.size > 0){
+      if(!o->active.array[f->depth]){
+        wl_orbits_enter(o, f->depth);
+      }
+      if(wl_orbits_explored(o, f->depth, v, p->perm[0].array + f->c, f->j)){
+        s->stats.skipped += 1;
+        continue;
+      }
+    }
+    int a[2] = { v, v };
+    wl_orbits_set_path(o, f->depth, v);
+    f->mark = arena_get_mark(&p->arena);
+    wl_partition_mark(p);
+    wl_individualize(s->g, s->rg, p, f->c, a);
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Search below the root partition p. The nodes of the path are frames on the stack of the workspace, as in
+ * wl_backtrack : the depth is only limited by memory.
+ * A child returning a depth above its parent, after a backjump, leaves the nodes in between
+ */
+void canon_backtrack(canon_search* s, wl_partition* p){
+  wl_frame_array* frames = &s->ws->frames;
+  wl_orbits* o = &s->ws->orbits;
+  int base = frames->size;
+  int r = canon_enter(s, p, 0, 0, 0);
+  while(frames->size > base){
+    wl_frame* f = &frames->array[frames->size - 1];
+    if(f->j >= 0){
+      // Child j is done, the search resumes at depth r
+      wl_partition_undo(p);
+      arena_release(&p->arena, f->mark);
+      if(r < f->depth){
+        wl_orbits_leave(o, f->depth);
+        frames->size -= 1;
+        continue;
+      }
+      // A new best leaf below the node has the same trace prefix
+      f->cmp = canon_compare_trace(s, f->depth) < 0 ? -1 : 0;
+    }
+    if(!canon_next(s, p, f)){
+      r = f->depth - 1;
+      wl_orbits_leave(o, f->depth);
+      frames->size -= 1;
+      continue;
+    }
+    // The frame may move when the child pushes its own
+    r = canon_enter(s, p, f->depth + 1, f->cmp, s->ws->target == WL_TARGET_FIRST ? f->c : 0);
+  }
+}
+
+canon_form graph_canonical_form_workspace(wl_workspace* ws, graph* g, graph* rg, canon_stats* stats){
+  assert(ws != NULL && g != NULL);
+  canon_search s;
+  s.g[0] = s.g[1] = g;
+  graph* rg_[2] = { rg, rg };
+  wl_workspace_reverse(ws, s.g, rg_, s.rg);
+  s.trace       = int_array_empty();
+  s.best_trace  = int_array_empty();
+  s.best_path   = int_array_empty();
+  s.best        = canon_form_empty();
+  s.first_trace = int_array_empty();
+  s.first_path  = int_array_empty();
+  s.first       = canon_form_empty();
+  s.ws          = ws;
+  s.labeling    = int_array_new(g->size);
+  s.stats.nodes = s.stats.leaves = s.stats.pruned = 0;
+  s.stats.depth = 0;
+  s.stats.automorphisms = s.stats.skipped = s.stats.backjumps = 0;
+  wl_orbits_reset(&ws->orbits, g->size);
+
+  // Certificates are defined with the hashed refinement, WL_REFINE_EXACT orders cells differently
+  int refine = ws->p.refine;
+  if(refine == WL_REFINE_EXACT){
+    ws->p.refine = WL_REFINE_HOPCROFT;
+  }
+  // Always valid with the same graph on both sides
+  bool valid = wl_graph_degree_partition_into(s.g, &ws->p);
+  assert(valid);
+  (void) valid;
+  canon_backtrack(&s, &ws->p);
+  ws->p.refine = refine;
+  if(ws->budget > 0 && s.stats.nodes > ws->budget){
+    canon_form_free(&s.best);
+    s.best = canon_form_empty();
+  }else{
+    s.best.hash = graph_hash(&s.best.certificate);
+  }
+
+  if(stats != NULL){
+    *stats = s.stats;
+  }
+  int_array_free(&s.trace);
+  int_array_free(&s.best_trace);
+  int_array_free(&s.best_path);
+  canon_form_free(&s.first);
+  int_array_free(&s.first_trace);
+  int_array_free(&s.first_path);
+  int_array_free(&s.labeling);
+  return s.best;
+}
+
+canon_form graph_canonical_form(graph* g){
+  wl_workspace ws = wl_workspace_new();
+  canon_form c = graph_canonical_form_workspace(&ws, g, NULL, NULL);
+  wl_workspace_free(&ws);
+  return c;
+}
@@ -0,0 +1,57 @@
+#ifndef ALGO_GISO_CANON_H
+#define ALGO_GISO_CANON_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "array.h"
+#include "graph.h"
+#include "wl.h"
+
+/*
+ * Canonical labeling
+ *
+ * The WL search tree is explored on a single graph : both sides of the wl_partition hold the same graph,
+ * and each individualized vertex is individualized on both sides.
+ * Class numbers only depend on the classes and vertices individualized so far, not on vertex labels,
+ * so the discrete partitions at the leaves give relabelings up to the choice of individualized vertices.
+ * The canonical leaf minimizes (trace of its path, relabeled graph), where the trace of a node is an invariant
+ * of its stable partition : subtrees whose trace prefix is already larger than the best one are pruned.
+ * A leaf with the same trace and certificate as the first or the best leaf gives an automorphism : the search
+ * goes back to the deepest node common to both paths, whose other children in the same orbit are then skipped.
+ *
+ * The certificate is the relabeled graph, two graphs are isomorphic iff their certificates are equal.
+ * It depends on the target cell strategy of the workspace, the index always uses WL_TARGET_FIRST.
+ */
+
+// Changes whenever certificates of the same graph change, stored certificates are then obsolete
+#define CANON_VERSION 5
+
+typedef struct canon_form {
+  int_array labeling;    // labeling.array[v] : canonical label of v
+  graph     certificate; // the graph relabeled by labeling
+  uint64_t  hash;        // graph_hash of the certificate
+} canon_form;
+
+typedef struct canon_stats {
+  long nodes;
+  long leaves;
+  long pruned;
+  int  depth;         // maximum depth
+  long automorphisms; // found between leaves with the same certificate
+  long skipped;       // children in the orbit of an explored one
+  long backjumps;     // subtrees left at a leaf equivalent to the first or the best one
+} canon_stats;
+
+canon_form canon_form_empty();
+bool canon_form_is_empty(canon_form* c);
+void canon_form_free(canon_form* c);
+bool canon_form_equal(canon_form* a, canon_form* b);
+// Isomorphism from the graph of a to the graph of b, int_array_empty() if they are not isomorphic
+int_array canon_form_isomorphism(canon_form* a, canon_form* b);
+
+// rg may be NULL, stats may be NULL. Empty form when the search needs more than ws->budget nodes
+canon_form graph_canonical_form_workspace(wl_workspace* ws, graph* g, graph* rg, canon_stats* stats);
+canon_form graph_canonical_form(graph* g);
+
+#endif
@@ -0,0 +1,256 @@
+#include "generator.h"
+
+#include "string.h"
+#include "math.h"
+#include "assert.h"
+#include "array.h"
+
+// Both arcs of the edge u v
+void generator_edge(int_array* src, int_array* dst, int u, int v){
+  int_array_append(src, u);
+  int_array_append(dst, v);
+  int_array_append(src, v);
+  int_array_append(dst, u);
+}
+
+graph generator_graph(int size, int_array* src, int_array* dst){
+  graph g = graph_from_edges(size, src->size, src->array, dst->array, NULL);
+  int_array_free(src);
+  int_array_free(dst);
+  return g;
+}
+
+// Pairs u < v in order, the gaps between the edges being geometric (Batagelj and Brandes)
+graph graph_gnp(int size, double p, uint64_t* state){
+  assert(size >= 0 && p >= 0. && p <= 1.);
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  if(p > 0. && size > 1){
+    double lq = log(1. - p);
+    int u = -1, v = 1;
+    while(v < size){
+      double skip = p < 1. ? floor(log(1. - random_double(state)) / lq) : 0.;
+      // u + 1 + skip may not fit in an int : the rows are skipped first
+      while(v < size && skip >= v - u - 1){
+        skip -= v - u - 1;
+        u = -1;
+        v += 1;
+      }
+      if(v < size){
+        u += 1 + (int) skip;
+        generator_edge(&src, &dst, u, v);
+      }
+    }
+  }
+  return generator_graph(size, &src, &dst);
+}
+
+bool generator_adjacent(const int* nb, const int* count, int degree, int u, int v){
+  for(int k = 0; k < count[u]; ++k){
+    if(nb[u * degree + k] == v){
+      return true;
+    }
+  }
+  return false;
+}
+
+graph graph_random_regular(int size, int degree, uint64_t* state){
+  assert(size > 0 && degree >= 0 && degree < size && ((long) size * degree) % 2 == 0);
+  int points = size * degree;
+  int* free_points = malloc((points > 0 ? points : 1) * sizeof(int));
+  int* nb          = malloc((points > 0 ? points : 1) * sizeof(int));
+  int* count       = malloc(size * sizeof(int));
+  bool done = false;
+  while(!done){
+    for(int k = 0; k < points; ++k){
+      free_points[k] = k;
+    }
+    memset(count, 0, size * sizeof(int));
+    int m = points;
+    int failures = 0;
+    // Stuck when the pairs left would make loops or multiple edges
+    while(m > 0 && failures < 100 + 10 * degree){
+      int i = random_int(state, m);
+      int j = random_int(state, m);
+      int u = free_points[i] / degree, v = free_points[j] / degree;
+      if(u == v || generator_adjacent(nb, count, degree, u, v)){
+        failures += 1;
+        continue;
+      }
+      failures = 0;
+      nb[u * degree + count[u]++] = v;
+      nb[v * degree + count[v]++] = u;
+      if(i < j){
+        SWAP(int, i, j);
+      }
+      free_points[i] = free_points[--m];
+      free_points[j] = free_points[--m];
+    }
+    done = m == 0;
+  }
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  for(int u = 0; u < size; ++u){
+    for(int k = 0; k < degree; ++k){
+      int v = nb[u * degree + k];
+      if(u < v){
+        generator_edge(&src, &dst, u, v);
+      }
+    }
+  }
+  free(free_points);
+  free(nb);
+  free(count);
+  return generator_graph(size, &src, &dst);
+}
+
+graph graph_grid(int width, int height, bool torus){
+  assert(width > 0 && height > 0);
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  for(int y = 0; y < height; ++y){
+    for(int x = 0; x < width; ++x){
+      int v = y * width + x;
+      if(x + 1 < width || (torus && width > 2)){
+        generator_edge(&src, &dst, v, y * width + (x + 1) % width);
+      }
+      if(y + 1 < height || (torus && height > 2)){
+        generator_edge(&src, &dst, v, ((y + 1) % height) * width + x);
+      }
+    }
+  }
+  return generator_graph(width * height, &src, &dst);
+}
+
+graph graph_paley(int q){
+  assert(q > 0 && q % 4 == 1);
+  bool* square = calloc(q, sizeof(bool));
+  for(long k = 1; k < q; ++k){
+    square[k * k % q] = true;
+  }
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  for(int i = 0; i < q; ++i){
+    for(int j = i + 1; j < q; ++j){
+      if(square[j - i]){
+        generator_edge(&src, &dst, i, j);
+      }
+    }
+  }
+  free(square);
+  return generator_graph(q, &src, &dst);
+}
+
+// Linear decoding : the smallest leaf is followed by a pointer which only moves forward
+graph graph_random_tree(int size, uint64_t* state){
+  assert(size > 0);
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  if(size == 2){
+    generator_edge(&src, &dst, 0, 1);
+  }else if(size > 2){
+    int* code   = malloc((size - 2) * sizeof(int));
+    int* degree = malloc(size * sizeof(int));
+    for(int v = 0; v < size; ++v){
+      degree[v] = 1;
+    }
+    for(int k = 0; k < size - 2; ++k){
+      code[k] = random_int(state, size);
+      degree[code[k]] += 1;
+    }
+    int ptr = 0;
+    while(degree[ptr] != 1){
+      ptr += 1;
+    }
+    int leaf = ptr;
+    for(int k = 0; k < size - 2; ++k){
+      int v = code[k];
+      generator_edge(&src, &dst, leaf, v);
+      degree[v] -= 1;
+      if(degree[v] == 1 && v < ptr){
+        leaf = v;
+      }else{
+        ptr += 1;
+        while(degree[ptr] != 1){
+          ptr += 1;
+        }
+        leaf = ptr;
+      }
+    }
+    // The last two vertices of degree 1
+    int last = size - 1;
+    generator_edge(&src, &dst, leaf, last);
+    free(code);
+    free(degree);
+  }
+  return generator_graph(size, &src, &dst);
+}
+
+graph graph_cfi(graph* base, bool twisted){
+  assert(base != NULL);
+  int n = base->size;
+  int* first = malloc((n + 1) * sizeof(int));
+  first[0] = 0;
+  for(int v = 0; v < n; ++v){
+    int d = graph_degree(base, v);
+    assert(d <= 16);
+    first[v + 1] = first[v] + 2 * d + (d > 0 ? 1 << (d - 1) : 1);
+  }
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  bool twist = twisted;
+  for(int v = 0; v < n; ++v){
+    int d = graph_degree(base, v);
+    int* nb = graph_neighbours(base, v);
+    // Middle vertices
+    int m = first[v] + 2 * d;
+    for(int mask = 0; mask < (1 << d); ++mask){
+      if(__builtin_popcount(mask) % 2 != 0){
+        continue;
+      }
+      for(int i = 0; i < d; ++i){
+        generator_edge(&src, &dst, m, first[v] + 2 * i + ((mask >> i) & 1));
+      }
+      m += 1;
+    }
+    // Edges of the base, from their smaller end
+    for(int i = 0; i < d; ++i){
+      int u = nb[i];
+      if(u <= v){
+        continue;
+      }
+      int j = 0;
+      int* nu = graph_neighbours(base, u);
+      while(nu[j] != v){
+        j += 1;
+      }
+      TWICE(x){
+        generator_edge(&src, &dst, first[v] + 2 * i + x, first[u] + 2 * j + (twist ? 1 - x : x));
+      }
+      twist = false;
+    }
+  }
+  int size = first[n];
+  free(first);
+  return generator_graph(size, &src, &dst);
+}
+
+graph graph_circular_ladder(int rungs){
+  assert(rungs >= 3);
+  int_array src = int_array_empty();
+  int_array dst = int_array_empty();
+  for(int k = 0; k < rungs; ++k){
+    int next = (k + 1) % rungs;
+    generator_edge(&src, &dst, 2 * k, 2 * k + 1);
+    generator_edge(&src, &dst, 2 * k, 2 * next);
+    generator_edge(&src, &dst, 2 * k + 1, 2 * next + 1);
+  }
+  return generator_graph(2 * rungs, &src, &dst);
+}
+
+graph graph_cfi_ladder(int rungs, bool twisted){
+  graph base = graph_circular_ladder(rungs);
+  graph g = graph_cfi(&base, twisted);
+  graph_free(&base);
+  return g;
+}
@@ -0,0 +1,41 @@
+#ifndef ALGO_GISO_GENERATOR_H
+#define ALGO_GISO_GENERATOR_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "graph.h"
+
+/*
+ * Generators of the families of graphs which are hard for isomorphism solvers
+ *
+ * All the graphs are undirected : every edge is stored as two arcs, without loops nor duplicates.
+ * Random generators draw from state only, so that a seed gives the same graph everywhere
+ */
+
+// G(n, p) : each of the size (size - 1) / 2 edges with probability p
+graph graph_gnp(int size, double p, uint64_t* state);
+// Uniform among the degree-regular graphs, by random pairing of the size * degree half edges, which restarts
+// when it gets stuck. size * degree is even and degree < size
+graph graph_random_regular(int size, int degree, uint64_t* state);
+// width * height grid, each vertex joined to its 4 neighbours, around the borders if torus
+graph graph_grid(int width, int height, bool torus);
+// Paley graph of the prime q = 1 mod 4 : i ~ j if i - j is a non zero square modulo q. Strongly regular
+graph graph_paley(int q);
+// Uniform labeled tree, decoded from a random Prüfer sequence
+graph graph_random_tree(int size, uint64_t* state);
+
+/*
+ * Cai-Fürer-Immerman construction over the connected base graph : a vertex v of degree d is replaced by
+ * 2 d end vertices a(v, i, 0), a(v, i, 1), i < d, and 2^(d - 1) middle vertices, one per even subset S of [0, d),
+ * joined to a(v, i, 1) for i in S and to a(v, i, 0) otherwise. Each edge of the base joins a(u, i, x) to a(v, j, x),
+ * or to a(v, j, 1 - x) for its first edge if twisted.
+ * The twisted and untwisted graphs aren't isomorphic, refinement alone can't tell them apart
+ */
+graph graph_cfi(graph* base, bool twisted);
+// Circular ladder of rungs rungs, 3-regular
+graph graph_circular_ladder(int rungs);
+// graph_cfi over graph_circular_ladder(rungs). Not the Miyazaki graphs, whose gadgets differ from those of graph_cfi
+graph graph_cfi_ladder(int rungs, bool twisted);
+
+#endif
@@ -1,54 +1,544 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "graph.h"
 
+#include "limits.h"
+#include "fcntl.h"
+#include "unistd.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+
+graph graph_empty(){
+  graph g;
+  g.size       = 0;
+  g.offsets    = NULL;
+  g.neighbours = NULL;
+  g.matrix     = bitset_empty();
+  g.matrix_stride = 0;
+  g.storage    = GRAPH_HEAP;
+  g.mapping    = NULL;
+  g.mapping_size = 0;
+  return g;
+}
+
+graph graph_new(int size, int nedge){
+  graph g = graph_empty();
+  g.size       = size;
+  g.offsets    = malloc((size + 1) * sizeof(int));
+  g.neighbours = malloc((nedge > 0 ? nedge : 1) * sizeof(int));
+  g.offsets[0] = 0;
+  return g;
+}
+
+/*
+ * The first pass buckets the edges by destination, which gives the reverse graph with unsorted lists
+ * Reversing it again buckets by source while scanning destinations in increasing order : lists come out sorted
+ */
+graph graph_from_edges(int size, int nedge, const int* src, const int* dst, graph* rg){
+  assert(nedge == 0 || (src != NULL && dst != NULL));
+  graph t = graph_new(size, nedge);
+  memset(t.offsets, 0, (size + 1) * sizeof(int));
+  for(int e = 0; e < nedge; ++e){
+    assert(src[e] >= 0 && src[e] < size);
+    assert(dst[e] >= 0 && dst[e] < size);
+    t.offsets[dst[e] + 1] += 1;
+  }
+  for(int i = 0; i < size; ++i){
+    t.offsets[i + 1] += t.offsets[i];
+  }
+  int* pos = malloc((size > 0 ? size : 1) * sizeof(int));
+  memcpy(pos, t.offsets, size * sizeof(int));
+  for(int e = 0; e < nedge; ++e){
+    t.neighbours[pos[dst[e]]++] = src[e];
+  }
+  free(pos);
+
+  graph g = graph_reverse(&t);
+  graph_free(&t);
+  graph_remove_duplicates(&g);
+
+  if(rg != NULL){
+    *rg = graph_reverse(&g);
+  }
+  return g;
+}
+
+void graph_remove_duplicates(graph* g){
+  assert(g != NULL && g->storage == GRAPH_HEAP);
+  // Lists are sorted, duplicated edges are adjacent
+  int cur = 0;
+  for(int i = 0; i < g->size; ++i){
+    int start = g->offsets[i], end = g->offsets[i + 1];
+    g->offsets[i] = cur;
+    for(int k = start; k < end; ++k){
+      if(cur == g->offsets[i] || g->neighbours[cur - 1] != g->neighbours[k]){
+        g->neighbours[cur] = g->neighbours[k];
+        cur += 1;
+      }
+    }
+  }
+  if(cur != g->offsets[g->size] && cur > 0){
+    g->neighbours = realloc(g->neighbours, cur * sizeof(int));
+  }
+  g->offsets[g->size] = cur;
+}
+
+// Transposing twice sorts the lists in O(size + nedge)
+graph graph_sort(graph* h){
+  assert(h != NULL);
+  graph t = graph_reverse(h);
+  graph g = graph_reverse(&t);
+  graph_free(&t);
+  graph_remove_duplicates(&g);
+  return g;
+}
 
 // O(size*size) memory, we can do O(size) with a binary tree (for instance)
-graph graph_random(int size, int nedge){
-  graph g = int_array_array_new(size);
+graph graph_random(int size, int nedge, uint64_t* state){
   int_array rnd = trivial_isomorphism(size*size);
+  int_array src = int_array_new(nedge);
+  int_array dst = int_array_new(nedge);
   for(int i = 0; i < nedge; ++i){
-    int j = i + rand() % (size*size-i);
+    int j = i + random_int(state, size*size-i);
     SWAP(int, rnd.array[i], rnd.array[j]);
-    int_array_append(&g.array[rnd.array[i] / size], rnd.array[i] % size);
+    src.array[i] = rnd.array[i] / size;
+    dst.array[i] = rnd.array[i] % size;
   }
   int_array_free(&rnd);
-  for(int i = 0; i < g.size; ++i){
-    int_array_sort_less(&g.array[i]);
-  }
+  graph g = graph_from_edges(size, nedge, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
   return g;
 }
 
-graph graph_read(){
+// Lists are filled in place, growing once per vertex, and sorted afterwards
+graph graph_read(reader* r){
   int size;
-  scanf("%d\n", &size);
-  graph g = int_array_array_new(size);
-  for(int i = 0; i < size; ++i) {
-    int n; scanf("%d", &n);
+  if(!reader_int(r, &size) || size < 0){
+    return graph_empty();
+  }
+  graph h = graph_empty();
+  h.size = size;
+  h.offsets = malloc((size + 1) * sizeof(int));
+  int_array nb = int_array_empty();
+  bool ok = true;
+  for(int i = 0; i < size && ok; ++i) {
+    h.offsets[i] = nb.size;
+    int n;
+    if(!reader_int(r, &n) || n < 0){
+      ok = false;
+      break;
+    }
+    int_array_grow(&nb, n);
     for(int j = 0; j < n; ++j){
-      int k; scanf("%d", &k);
-      int_array_append(&g.array[i], k);
+      int k;
+      if(!reader_int(r, &k) || k < 0 || k >= size){
+        ok = false;
+        break;
+      }
+      nb.array[nb.size] = k;
+      nb.size += 1;
     }
   }
-  for(int i = 0; i < g.size; ++i){
-    int_array_sort_less(&g.array[i]);
+  h.offsets[size] = nb.size;
+  h.neighbours = nb.array;
+  if(!ok){
+    graph_free(&h);
+    return graph_empty();
+  }
+  graph g = graph_sort(&h);
+  graph_free(&h);
+  return g;
+}
+
+// Beyond it, the arrays of the arcs announced by a header grow with the arcs read
+#define GRAPH_HEADER_RESERVE (1 << 22)
+
+// Empty array with room for the arcs announced by a header, which isn't trusted
+int_array graph_header_arcs(long arcs){
+  int_array a = int_array_empty();
+  int_array_reserve(&a, arcs < GRAPH_HEADER_RESERVE ? (int) arcs : GRAPH_HEADER_RESERVE);
+  return a;
+}
+
+/*
+ * Edge list : "size nedge" then nedge lines "src dst", vertices numbered from 0, directed edges
+ * Lines starting with '#' or '%' are comments
+ */
+graph graph_read_edges(reader* r){
+  int size, nedge;
+  reader_skip_comments(r, "#%");
+  if(!reader_int(r, &size) || !reader_int(r, &nedge) || size < 0 || nedge < 0 || nedge > (long) size * size){
+    return graph_empty();
+  }
+  int_array src = graph_header_arcs(nedge);
+  int_array dst = graph_header_arcs(nedge);
+  for(int e = 0; e < nedge; ++e){
+    reader_skip_comments(r, "#%");
+    int u, v;
+    if(!reader_int(r, &u) || !reader_int(r, &v) || u < 0 || u >= size || v < 0 || v >= size){
+      int_array_free(&src);
+      int_array_free(&dst);
+      return graph_empty();
+    }
+    int_array_append(&src, u);
+    int_array_append(&dst, v);
+  }
+  graph g = graph_from_edges(size, nedge, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
+  return g;
+}
+
+/*
+ * DIMACS : "c" comment lines, one "p edge size nedge" line, then nedge lines "e u v", vertices numbered from 1
+ * Edges are undirected
+ */
+graph graph_read_dimacs(reader* r){
+  int size = -1, nedge = -1;
+  while(reader_skip_spaces(r) && size < 0){
+    int c = reader_getc(r);
+    if(c == 'p'){
+      // Problem name
+      reader_skip_spaces(r);
+      while((c = reader_peek(r)) != EOF && !reader_is_space(c)){
+        reader_getc(r);
+      }
+      // Some files list each edge in both directions
+      if(!reader_int(r, &size) || !reader_int(r, &nedge) || size < 0 || nedge < 0
+         || nedge > INT_MAX / 2 || nedge > (long) size * size){
+        return graph_empty();
+      }
+    }else if(c == 'c'){
+      reader_skip_line(r);
+    }else{
+      return graph_empty();
+    }
+  }
+  if(size < 0){
+    return graph_empty();
+  }
+  int_array src = graph_header_arcs(2 * (long) nedge);
+  int_array dst = graph_header_arcs(2 * (long) nedge);
+  int e = 0;
+  while(e < nedge){
+    reader_skip_spaces(r);
+    int c = reader_getc(r);
+    int u, v;
+    if(c == 'c'){
+      reader_skip_line(r);
+    }else if(c == 'e' && reader_int(r, &u) && reader_int(r, &v)
+             && u >= 1 && u <= size && v >= 1 && v <= size){
+      int_array_append(&src, u - 1);
+      int_array_append(&dst, v - 1);
+      int_array_append(&src, v - 1);
+      int_array_append(&dst, u - 1);
+      e += 1;
+    }else{
+      int_array_free(&src);
+      int_array_free(&dst);
+      return graph_empty();
+    }
   }
+  graph g = graph_from_edges(size, 2 * nedge, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
   return g;
 }
 
-graph graph_read_matrix(){
+/*
+ * graph6 / sparse6 : one graph per line, 6 bits per byte (byte - 63), most significant bit first
+ * See formats.txt in the nauty distribution
+ */
+
+typedef struct bits6 {
+  const char* data;
+  size_t      length;
+  size_t      pos;  // next byte
+  int         bit;  // bits left in the current byte
+} bits6;
+
+bits6 bits6_new(const char* data, size_t length){
+  bits6 b = { data, length, 0, 0 };
+  return b;
+}
+
+// -1 at the end of data
+int bits6_next(bits6* b){
+  if(b->bit == 0){
+    if(b->pos == b->length){
+      return -1;
+    }
+    b->pos += 1;
+    b->bit = 6;
+  }
+  b->bit -= 1;
+  return ((b->data[b->pos - 1] - 63) >> b->bit) & 1;
+}
+
+// Reads N(n), returns -1 if invalid
+long graph6_size(const char* s, size_t length, size_t* pos){
+  int bytes = 1;
+  if(length > 0 && s[0] == 126){
+    bytes = (length > 1 && s[1] == 126) ? 6 : 3;
+    *pos = (bytes == 6) ? 2 : 1;
+  }else{
+    *pos = 0;
+  }
+  if(*pos + bytes > length){
+    return -1;
+  }
+  long n = 0;
+  for(int i = 0; i < bytes; ++i){
+    int c = s[*pos + i] - 63;
+    if(c < 0 || c > 63){
+      return -1;
+    }
+    n = (n << 6) | c;
+  }
+  *pos += bytes;
+  return n;
+}
+
+// Skips an optional ">>graph6<<" style header, returns the line of the graph
+const char* graph6_line(reader* r, const char* header, size_t* length){
+  if(!reader_skip_spaces(r)){
+    return NULL;
+  }
+  const char* s = reader_line(r, length);
+  size_t h = strlen(header);
+  if(*length >= h && memcmp(s, header, h) == 0){
+    s += h;
+    *length -= h;
+  }
+  return s;
+}
+
+// Counting pass (edges == NULL) or filling pass, returns the number of undirected edges, -1 if invalid
+int graph6_edges(bits6 b, int size, int* src, int* dst){
+  int m = 0;
+  for(int j = 1; j < size; ++j){
+    for(int i = 0; i < j; ++i){
+      int x = bits6_next(&b);
+      if(x == 1){
+        // 2 m arcs
+        if(m == INT_MAX / 2){
+          return -1;
+        }
+        if(src != NULL){
+          src[2*m] = i; dst[2*m] = j;
+          src[2*m+1] = j; dst[2*m+1] = i;
+        }
+        m += 1;
+      }else if(x < 0){
+        return -1;
+      }
+    }
+  }
+  return m;
+}
+
+graph graph_read_graph6(reader* r){
+  size_t length, pos;
+  const char* s = graph6_line(r, ">>graph6<<", &length);
+  if(s == NULL || (length > 0 && s[0] == ':')){
+    return graph_empty();
+  }
+  long size = graph6_size(s, length, &pos);
+  if(size < 0 || size > INT_MAX){
+    return graph_empty();
+  }
+  bits6 b = bits6_new(s + pos, length - pos);
+  int m = graph6_edges(b, size, NULL, NULL);
+  if(m < 0){
+    return graph_empty();
+  }
+  int_array src = int_array_new(2 * m);
+  int_array dst = int_array_new(2 * m);
+  graph6_edges(b, size, src.array, dst.array);
+  graph g = graph_from_edges(size, 2 * m, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
+  return g;
+}
+
+// Counting pass (edges == NULL) or filling pass, returns the number of undirected edges, -1 if invalid
+int sparse6_edges(bits6 b, int size, int k, int* src, int* dst){
+  int m = 0;
+  long v = 0;
+  while(true){
+    int bit = bits6_next(&b);
+    if(bit < 0){
+      break;
+    }
+    long x = 0;
+    int i;
+    for(i = 0; i < k; ++i){
+      int c = bits6_next(&b);
+      if(c < 0){
+        break;
+      }
+      x = (x << 1) | c;
+    }
+    // Incomplete pair at the end : padding
+    if(i != k){
+      break;
+    }
+    if(bit == 1){
+      v += 1;
+    }
+    if(v >= size){
+      break;
+    }
+    if(x > v){
+      v = x;
+    }else{
+      // 2 m arcs
+      if(m == INT_MAX / 2){
+        return -1;
+      }
+      if(src != NULL){
+        src[2*m] = x; dst[2*m] = v;
+        src[2*m+1] = v; dst[2*m+1] = x;
+      }
+      m += 1;
+    }
+  }
+  return m;
+}
+
+graph graph_read_sparse6(reader* r){
+  size_t length, pos;
+  const char* s = graph6_line(r, ">>sparse6<<", &length);
+  if(s == NULL || length == 0 || s[0] != ':'){
+    return graph_empty();
+  }
+  long size = graph6_size(s + 1, length - 1, &pos);
+  if(size < 0 || size > INT_MAX){
+    return graph_empty();
+  }
+  pos += 1;
+  int k = 0;
+  while(((long) 1 << k) < size){
+    k += 1;
+  }
+  bits6 b = bits6_new(s + pos, length - pos);
+  int m = sparse6_edges(b, size, k, NULL, NULL);
+  if(m < 0){
+    return graph_empty();
+  }
+  int_array src = int_array_new(2 * m);
+  int_array dst = int_array_new(2 * m);
+  sparse6_edges(b, size, k, src.array, dst.array);
+  graph g = graph_from_edges(size, 2 * m, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
+  return g;
+}
+
+int graph_format_from_name(const char* name){
+  const char* names[] = GRAPH_FORMAT_NAMES;
+  for(int i = 0; i < GRAPH_FORMAT_COUNT; ++i){
+    if(strcmp(name, names[i]) == 0){
+      return i;
+    }
+  }
+  return -1;
+}
+
+graph graph_read_format(reader* r, int format){
+  switch(format){
+  case GRAPH_FORMAT_MATRIX:
+    return graph_read_matrix(r);
+  case GRAPH_FORMAT_LIST:
+    return graph_read(r);
+  case GRAPH_FORMAT_EDGES:
+    return graph_read_edges(r);
+  case GRAPH_FORMAT_DIMACS:
+    return graph_read_dimacs(r);
+  case GRAPH_FORMAT_GRAPH6:
+    return graph_read_graph6(r);
+  case GRAPH_FORMAT_SPARSE6:
+    return graph_read_sparse6(r);
+  default:
+    // Binary graphs are loaded from files
+    return graph_empty();
+  }
+}
+
+/*
+ * Word at a time scan of the matrix rows
+ * 8 cells are loaded at once ; xoring with '0' bytes gives 0/1 bytes when all cells are valid,
+ * and the multiplication gathers the 8 low bits in the top byte (cell k in bit k)
+ */
+#define MATRIX_ZEROS UINT64_C(0x3030303030303030)
+#define MATRIX_ONES  UINT64_C(0x0101010101010101)
+#define MATRIX_GATHER UINT64_C(0x0102040810204080)
+
+// Rows are read in order and columns in increasing order : lists are sorted without any sort
+graph graph_read_matrix(reader* r){
   int size;
-  scanf("%d", &size);
-  graph g = int_array_array_new(size);
+  if(!reader_int(r, &size) || size < 0){
+    return graph_empty();
+  }
+  graph g = graph_empty();
+  g.size = size;
+  g.offsets = malloc((size + 1) * sizeof(int));
+  int_array nb = int_array_empty();
   for(int i = 0; i < size; ++i){
-    for(int j = 0; j < size; ++j){
-      char c = '\n'; while(c == '\n') scanf("%c", &c);
+    g.offsets[i] = nb.size;
+    int_array_grow(&nb, size);
+    int j = 0;
+    reader_skip_spaces(r);
+    if(reader_ensure(r, size) >= (size_t) size){
+      const char* s = reader_data(r);
+      while(j + 8 <= size){
+        uint64_t w;
+        memcpy(&w, s + j, 8);
+        w ^= MATRIX_ZEROS;
+        if(w & ~MATRIX_ONES){
+          break;
+        }
+        // Bytes are loaded in little endian order
+        unsigned mask = (w * MATRIX_GATHER) >> 56;
+        while(mask){
+          nb.array[nb.size] = j + __builtin_ctz(mask);
+          nb.size += 1;
+          mask &= mask - 1;
+        }
+        j += 8;
+      }
+      while(j < size && (s[j] == '0' || s[j] == '1')){
+        if(s[j] == '1'){
+          nb.array[nb.size] = j;
+          nb.size += 1;
+        }
+        j += 1;
+      }
+      reader_advance(r, j);
+    }
+    // Rows split over several lines
+    while(j < size){
+      int c = reader_getc(r);
+      if(c == EOF){
+        int_array_free(&nb);
+        free(g.offsets);
+        return graph_empty();
+      }
+      if(reader_is_space(c)){
+        continue;
+      }
       if(c == '1'){
-        int_array_append(&g.array[i], j);
+        nb.array[nb.size] = j;
+        nb.size += 1;
       }
+      j += 1;
     }
   }
-  for(int i = 0; i < g.size; ++i){
-    int_array_sort_less(&g.array[i]);
-  }
+  g.offsets[size] = nb.size;
+  // Each row reserved room for size neighbours
+  int_array_shrink(&nb);
+  g.neighbours = nb.array;
   return g;
 }
 
@@ -56,79 +546,347 @@ void graph_write_matrix(graph* g){
   printf("%d\n", g->size);
   for(int i = 0; i < g->size; ++i){
     for(int j = 0; j < g->size; ++j){
-      printf("%c", int_array_binary_search(&g->array[i], j)?'1':'0');
+      printf("%c", graph_has_edge(g, i, j)?'1':'0');
     }
     printf("\n");
   }
 }
 
+bool graph_is_empty(graph* g){
+  assert(g != NULL);
+  return g->offsets == NULL;
+}
+
 void graph_free(graph* g){
   assert(g != NULL);
+  if(g->storage == GRAPH_HEAP){
+    if(g->offsets){
+      free(g->offsets);
+    }
+    if(g->neighbours){
+      free(g->neighbours);
+    }
+  }else if(g->storage == GRAPH_MAPPED){
+    munmap(g->mapping, g->mapping_size);
+  }
+  graph_free_matrix(g);
+}
+
+bool graph_write_binary(graph* g, graph* rg, const char* path){
+  assert(g != NULL);
+  assert(rg == NULL || (rg->size == g->size && graph_edge_count(rg) == graph_edge_count(g)));
+  FILE* f = fopen(path, "wb");
+  if(f == NULL){
+    return false;
+  }
+  graph_binary_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GRAPH_BINARY_MAGIC, 4);
+  header.version = GRAPH_BINARY_VERSION;
+  header.flags   = rg != NULL ? GRAPH_BINARY_REVERSE : 0;
+  header.endian  = GRAPH_BINARY_ENDIAN;
+  header.size    = g->size;
+  header.nedge   = graph_edge_count(g);
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  graph* h[2] = { g, rg };
+  TWICE(i) if(ok && h[i] != NULL){
+    ok = fwrite(h[i]->offsets, sizeof(int), g->size + 1, f) == (size_t) g->size + 1
+      && fwrite(h[i]->neighbours, sizeof(int), header.nedge, f) == (size_t) header.nedge;
+  }
+  return fclose(f) == 0 && ok;
+}
+
+bool graph_check_lists(const graph* g, int nedge){
+  if(g->offsets[0] != 0 || g->offsets[g->size] != nedge){
+    return false;
+  }
   for(int i = 0; i < g->size; ++i){
-    int_array_free(&g->array[i]);
+    int begin = g->offsets[i], end = g->offsets[i + 1];
+    if(end < begin || end > nedge){
+      return false;
+    }
+    for(int j = begin; j < end; ++j){
+      int v = g->neighbours[j];
+      if(v < 0 || v >= g->size || (j > begin && v <= g->neighbours[j - 1])){
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+graph graph_load_binary(const char* path, graph* rg, bool check){
+  int fd = open(path, O_RDONLY);
+  if(fd < 0){
+    return graph_empty();
   }
-  free(g->array);
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(graph_binary_header)){
+    close(fd);
+    return graph_empty();
+  }
+  void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED){
+    return graph_empty();
+  }
+  graph_binary_header* header = mapping;
+  size_t lists = (size_t) header->size + 1 + header->nedge;
+  bool reverse = header->flags & GRAPH_BINARY_REVERSE;
+  if(memcmp(header->magic, GRAPH_BINARY_MAGIC, 4) != 0
+     || header->version != GRAPH_BINARY_VERSION
+     || header->endian != GRAPH_BINARY_ENDIAN
+     || header->size < 0 || header->nedge < 0
+     || (size_t) st.st_size != sizeof(graph_binary_header) + (reverse ? 2 : 1) * lists * sizeof(int)){
+    munmap(mapping, st.st_size);
+    return graph_empty();
+  }
+  int* data = (int*) (header + 1);
+  graph g = graph_empty();
+  g.size         = header->size;
+  g.offsets      = data;
+  g.neighbours   = data + header->size + 1;
+  g.storage      = GRAPH_MAPPED;
+  g.mapping      = mapping;
+  g.mapping_size = st.st_size;
+  graph r = graph_empty();
+  if(reverse){
+    r.size       = header->size;
+    r.offsets    = data + lists;
+    r.neighbours = data + lists + header->size + 1;
+    r.storage    = GRAPH_BORROWED;
+  }
+  bool valid = check ? graph_check_lists(&g, header->nedge) && (!reverse || graph_check_lists(&r, header->nedge))
+                     : g.offsets[0] == 0 && graph_edge_count(&g) == header->nedge;
+  if(!valid){
+    munmap(mapping, st.st_size);
+    return graph_empty();
+  }
+  if(rg != NULL){
+    if(reverse){
+      *rg = r;
+    }else{
+      *rg = graph_reverse(&g);
+    }
+  }
+  return g;
+}
+
+bool graph_build_matrix(graph* g, size_t budget){
+  assert(g != NULL);
+  int stride = BITSET_WORDS(g->size);
+  if((size_t) g->size * stride * sizeof(uint64_t) > budget
+     || (size_t) g->size * stride * 64 > INT_MAX){
+    return false;
+  }
+  graph_free_matrix(g);
+  g->matrix = bitset_new(g->size * stride * 64);
+  g->matrix_stride = stride;
+  for(int i = 0; i < g->size; ++i){
+    int* nb = graph_neighbours(g, i);
+    for(int k = 0; k < graph_degree(g, i); ++k){
+      bitset_set(&g->matrix, i * stride * 64 + nb[k]);
+    }
+  }
+  return true;
+}
+
+void graph_free_matrix(graph* g){
+  assert(g != NULL);
+  bitset_free(&g->matrix);
+  g->matrix = bitset_empty();
+  g->matrix_stride = 0;
+}
+
+bool graph_row_equal(const graph* a, int i, const graph* b, int j){
+  assert(a != NULL && b != NULL);
+  assert(a->size == b->size);
+  if(graph_degree(a, i) != graph_degree(b, j)){
+    return false;
+  }
+  if(graph_has_matrix(a) && graph_has_matrix(b)){
+    return memcmp(graph_matrix_row(a, i), graph_matrix_row(b, j), a->matrix_stride * sizeof(uint64_t)) == 0;
+  }
+  return memcmp(graph_neighbours(a, i), graph_neighbours(b, j), graph_degree(a, i) * sizeof(int)) == 0;
+}
+
+bool graph_equal(const graph* a, const graph* b){
+  assert(a != NULL && b != NULL);
+  if(a->size != b->size || graph_edge_count(a) != graph_edge_count(b)){
+    return false;
+  }
+  for(int i = 0; i < a->size; ++i){
+    if(!graph_row_equal(a, i, b, i)){
+      return false;
+    }
+  }
+  return true;
+}
+
+// Lexicographic order on (size, offsets, neighbours)
+int graph_compare(const graph* a, const graph* b){
+  assert(a != NULL && b != NULL);
+  if(a->size != b->size){
+    return a->size < b->size ? -1 : 1;
+  }
+  for(int i = 0; i <= a->size; ++i){
+    if(a->offsets[i] != b->offsets[i]){
+      return a->offsets[i] < b->offsets[i] ? -1 : 1;
+    }
+  }
+  for(int e = 0; e < graph_edge_count(a); ++e){
+    if(a->neighbours[e] != b->neighbours[e]){
+      return a->neighbours[e] < b->neighbours[e] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+uint64_t fnv_mix(uint64_t h, uint32_t x){
+  for(int k = 0; k < 4; ++k){
+    h ^= (x >> (8 * k)) & 0xff;
+    h *= UINT64_C(1099511628211);
+  }
+  return h;
+}
+
+// FNV-1a over size, offsets and neighbours
+uint64_t graph_hash(const graph* g){
+  assert(g != NULL);
+  uint64_t h = UINT64_C(14695981039346656037);
+  h = fnv_mix(h, g->size);
+  for(int i = 0; i <= g->size; ++i){
+    h = fnv_mix(h, g->offsets[i]);
+  }
+  for(int e = 0; e < graph_edge_count(g); ++e){
+    h = fnv_mix(h, g->neighbours[e]);
+  }
+  return h;
 }
 
 partition graph_degree_partition(graph* g){
   assert(g != NULL);
   partition a = partition_new_with_classes(g->size, g->size + 1);
   for(int i = 0; i < g->size; ++i){
-    partition_set_class(&a, i, g->array[i].size);
+    partition_set_class(&a, i, graph_degree(g, i));
   }
   // partition_cleanup(&a);
   return a;
 }
 
 wl_partition wl_graph_degree_partition(graph* g[2]){
+  wl_partition p = wl_partition_empty();
+  if(!wl_graph_degree_partition_into(g, &p)){
+    wl_partition_free(&p);
+    p = wl_partition_empty();
+  }
+  return p;
+}
+
+// Cells by increasing degree, each side sorted with a counting pass
+bool wl_graph_degree_partition_into(graph* g[2], wl_partition* p){
   assert(g[0] != NULL && g[1] != NULL);
   assert(g[0]->size == g[1]->size);
-  wl_partition p = wl_partition_new_with_classes(g[0]->size, g[0]->size + 1);
-  TWICE(j) for(int i = 0; i < g[j]->size; ++i){
-    wl_partition_set_class_single(&p, g[j]->array[i].size, j, i);
-    for(int k = 0; k < g[j]->array[i].size; ++k){
-      int a = g[j]->array[i].array[k];
-      p.elements_hash[j].array[i] += wl_hash_f(g[j]->array[a].size);
-      p.elements_hash[j].array[a] += int_rotate(wl_hash_f(g[j]->array[i].size));
-    }
-  }
-  /* if(!wl_partition_cleanup(&p)){ */
-  /*   wl_partition_free(&p); */
-  /*   p = wl_partition_empty(); */
-  /* }else{ */
-  int_set_free(&p.update_queue);
-  p.update_queue = int_set_range(0, p.partition.size-1);
-  /* } */
-  return p;
+  assert(p != NULL);
+  int n = g[0]->size;
+  wl_partition_reset(p, n);
+  int_array count[2];
+  TWICE(j){
+    count[j] = int_array_new(n + 1);
+    memset(count[j].array, 0, (n + 1) * sizeof(int));
+    for(int i = 0; i < n; ++i){
+      count[j].array[graph_degree(g[j], i)] += 1;
+    }
+  }
+  bool valid = memcmp(count[0].array, count[1].array, (n + 1) * sizeof(int)) == 0;
+  if(valid){
+    // count[0] : first position of the cell of each degree, count[1] : next free position in it
+    int start = 0;
+    p->cells = 0;
+    for(int d = 0; d <= n; ++d){
+      int c = count[0].array[d];
+      if(c != 0){
+        p->cell_size.array[start] = c;
+        p->cells += 1;
+        int_worklist_insert(&p->update_queue, start);
+      }
+      count[0].array[d] = start;
+      start += c;
+    }
+    TWICE(j){
+      memcpy(count[1].array, count[0].array, (n + 1) * sizeof(int));
+      for(int i = 0; i < n; ++i){
+        int d = graph_degree(g[j], i);
+        int pos = count[1].array[d];
+        count[1].array[d] += 1;
+        p->perm[j].array[pos]   = i;
+        p->position[j].array[i] = pos;
+        p->elements[j].array[i] = count[0].array[d];
+      }
+    }
+    TWICE(j) for(int i = 0; i < n; ++i){
+      int* nb = graph_neighbours(g[j], i);
+      for(int k = 0; k < graph_degree(g[j], i); ++k){
+        int a = nb[k];
+        p->elements_hash[j][WL_LANE_FORWARD][a] += wl_hash_f(p->elements[j].array[i]);
+        p->elements_hash[j][WL_LANE_REVERSE][i] += wl_hash_f(p->elements[j].array[a]);
+      }
+    }
+  }
+  TWICE(j) int_array_free(&count[j]);
+  return valid;
 }
 
+// Counting pass then filling pass ; sources are scanned in increasing order so lists come out sorted
 graph graph_reverse(graph* g){
   assert(g != NULL);
-  graph h = int_array_array_new(g->size);
+  graph h = graph_empty();
+  graph_reverse_into(g, &h);
+  return h;
+}
+
+void graph_reverse_into(graph* g, graph* h){
+  assert(g != NULL && h != NULL);
+  assert(h->storage == GRAPH_HEAP);
+  int nedge = graph_edge_count(g);
+  graph_free_matrix(h);
+  h->size       = g->size;
+  h->offsets    = realloc(h->offsets, (g->size + 1) * sizeof(int));
+  h->neighbours = realloc(h->neighbours, (nedge > 0 ? nedge : 1) * sizeof(int));
+  memset(h->offsets, 0, (g->size + 1) * sizeof(int));
+  for(int e = 0; e < nedge; ++e){
+    h->offsets[g->neighbours[e] + 1] += 1;
+  }
+  for(int i = 0; i < h->size; ++i){
+    h->offsets[i + 1] += h->offsets[i];
+  }
+  // Shift the offsets instead of allocating a position array : h->offsets[i+1] is the fill position of i
+  for(int i = h->size; i > 0; --i){
+    h->offsets[i] = h->offsets[i - 1];
+  }
   for(int i = 0; i < g->size; ++i){
-    for(int j = 0; j < g->array[i].size; ++j){
-      int_array_append(&h.array[g->array[i].array[j]], i);
+    int* nb = graph_neighbours(g, i);
+    for(int j = 0; j < graph_degree(g, i); ++j){
+      h->neighbours[h->offsets[nb[j] + 1]++] = i;
     }
   }
-  for(int i = 0; i < h.size; ++i){
-    int_array_sort_less(&h.array[i]);
-  }
-  return h;
 }
 
 graph graph_apply_isomorphism(graph* g, int_array* iso){
   assert(g != NULL);
   assert(iso != NULL);
   assert(g->size == iso->size);
-  graph h = int_array_array_new(g->size);
+  int nedge = graph_edge_count(g);
+  int_array src = int_array_new(nedge);
+  int_array dst = int_array_new(nedge);
   for(int i = 0; i < g->size; ++i){
-    for(int j = 0; j < g->array[i].size; ++j){
-      int_array_append(&h.array[iso->array[i]], iso->array[g->array[i].array[j]]);
+    for(int j = g->offsets[i]; j < g->offsets[i + 1]; ++j){
+      src.array[j] = iso->array[i];
+      dst.array[j] = iso->array[g->neighbours[j]];
     }
   }
-  for(int i = 0; i < h.size; ++i){
-    int_array_sort_less(&h.array[i]);
-  }
+  graph h = graph_from_edges(g->size, nedge, src.array, dst.array, NULL);
+  int_array_free(&src);
+  int_array_free(&dst);
   return h;
 }
-
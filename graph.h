@@ -5,27 +5,153 @@
 #include "stdio.h"
 
 #include "array.h"
+#include "bitset.h"
 #include "partition.h"
+#include "reader.h"
 #include "util.h"
 #include "wl_partition.h"
 
 /*
  * Choix effectués:
- * Représentation des graphes sous forme de listes d'adjacences.
- * Ces listes d'adjacences sont en fait des tableaux, triés pour pouvoir effectuer des recherches en temps logarithmique
+ * Représentation des graphes au format CSR (compressed sparse row) :
+ * un tableau d'offsets de taille size + 1 et un unique tableau contigu de voisins.
+ * Les voisins du sommet i sont neighbours[offsets[i] .. offsets[i+1] - 1].
+ * Ces listes d'adjacences sont triées pour pouvoir effectuer des recherches en temps logarithmique
+ * Optionnellement, une matrice d'adjacence (une ligne de matrix_stride mots de 64 bits par sommet)
+ * est construite à côté des listes pour les tests d'arête en temps constant
+ *
+ * Format binaire (version 1), entiers 32 bits dans l'ordre natif :
+ *   en-tête graph_binary_header, offsets[size + 1], neighbours[nedge],
+ *   puis, si GRAPH_BINARY_REVERSE, offsets et neighbours du graphe inverse.
+ * Le chargeur projette le fichier en mémoire (mmap) et l'utilise en place
  */
 
-typedef int_array_array graph;
+// Default memory budget for the adjacency matrix of a single graph (64 MiB, n <= 23170)
+#define GRAPH_MATRIX_BUDGET ((size_t) 64 << 20)
 
-graph graph_random(int size, int nedge);
-graph graph_read();
-graph graph_read_matrix();
+// Storage of offsets and neighbours
+#define GRAPH_HEAP     0 // malloc'd, freed by graph_free
+#define GRAPH_MAPPED   1 // points into mapping, unmapped by graph_free
+#define GRAPH_BORROWED 2 // points into the mapping of another graph, which must outlive it
+
+typedef struct graph {
+  int    size;
+  int*   offsets;
+  int*   neighbours;
+  bitset matrix;
+  int    matrix_stride;
+  int    storage;
+  void*  mapping;
+  size_t mapping_size;
+} graph;
+
+#define GRAPH_BINARY_MAGIC   "GISO"
+#define GRAPH_BINARY_VERSION 1
+#define GRAPH_BINARY_ENDIAN  0x01020304
+#define GRAPH_BINARY_REVERSE 1
+
+typedef struct graph_binary_header {
+  char     magic[4];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t endian;
+  int32_t  size;
+  int32_t  nedge;
+  uint64_t reserved;
+} graph_binary_header;
+
+static inline int graph_degree(const graph* g, int i){
+  return g->offsets[i+1] - g->offsets[i];
+}
+
+static inline int* graph_neighbours(const graph* g, int i){
+  return g->neighbours + g->offsets[i];
+}
+
+static inline int graph_edge_count(const graph* g){
+  return g->offsets[g->size];
+}
+
+static inline bool graph_has_matrix(const graph* g){
+  return g->matrix.array != NULL;
+}
+
+static inline const uint64_t* graph_matrix_row(const graph* g, int i){
+  return g->matrix.array + (size_t) i * g->matrix_stride;
+}
+
+// O(1) with the adjacency matrix, O(log d) binary search otherwise
+static inline bool graph_has_edge(const graph* g, int i, int j){
+  assert(i >= 0 && i < g->size);
+  if(graph_has_matrix(g)){
+    return (graph_matrix_row(g, i)[j >> 6] >> (j & 63)) & 1;
+  }
+  return int_binary_search(graph_neighbours(g, i), graph_degree(g, i), j);
+}
+
+graph graph_empty();
+graph graph_new(int size, int nedge);
+// Two counting passes, no comparison sort, duplicated edges are removed
+// If rg is not NULL, the reverse graph is built as well
+graph graph_from_edges(int size, int nedge, const int* src, const int* dst, graph* rg);
+graph graph_random(int size, int nedge, uint64_t* state);
+void graph_remove_duplicates(graph* g);
+// Sorted copy of a graph with unsorted lists
+graph graph_sort(graph* h);
+
+/*
+ * Readers return graph_empty() on malformed input
+ * They never grow an array once per edge : edge counts come from headers or from a counting pass
+ */
+#define GRAPH_FORMAT_MATRIX  0
+#define GRAPH_FORMAT_LIST    1
+#define GRAPH_FORMAT_EDGES   2
+#define GRAPH_FORMAT_DIMACS  3
+#define GRAPH_FORMAT_GRAPH6  4
+#define GRAPH_FORMAT_SPARSE6 5
+#define GRAPH_FORMAT_BINARY  6
+#define GRAPH_FORMAT_COUNT   7
+#define GRAPH_FORMAT_NAMES { "matrix", "list", "edges", "dimacs", "graph6", "sparse6", "binary" }
+
+// -1 if unknown
+int graph_format_from_name(const char* name);
+graph graph_read_format(reader* r, int format);
+// size, then for each vertex its degree and its neighbours
+graph graph_read(reader* r);
+graph graph_read_matrix(reader* r);
+graph graph_read_edges(reader* r);
+graph graph_read_dimacs(reader* r);
+graph graph_read_graph6(reader* r);
+graph graph_read_sparse6(reader* r);
 void graph_write_matrix(graph* g);
+// rg may be NULL, the reverse graph is stored when given
+bool graph_write_binary(graph* g, graph* rg, const char* path);
+// The file is mapped and used in place. If rg is not NULL, it receives the stored reverse graph
+// (borrowing the mapping of the returned graph), or a freshly computed one if the file has none.
+// check : O(n + m) pass over the lists, offsets non decreasing and neighbours sorted in [0, size).
+// Without it the loading is O(1) but the file is trusted : the lists are indexed without bounds checks
+graph graph_load_binary(const char* path, graph* rg, bool check);
+// Offsets non decreasing from 0 to nedge, each list strictly increasing in [0, size)
+bool graph_check_lists(const graph* g, int nedge);
+bool graph_is_empty(graph* g);
 void graph_free(graph* g);
+// Builds the adjacency matrix if it fits in budget bytes, returns whether it was built
+bool graph_build_matrix(graph* g, size_t budget);
+void graph_free_matrix(graph* g);
+// Same neighbour set for vertex i of a and vertex j of b
+bool graph_row_equal(const graph* a, int i, const graph* b, int j);
+bool graph_equal(const graph* a, const graph* b);
+// Lexicographic order on (size, offsets, neighbours)
+int graph_compare(const graph* a, const graph* b);
+uint64_t graph_hash(const graph* g);
 partition graph_degree_partition(graph* g);
 // empty partition if invalid
 wl_partition wl_graph_degree_partition(graph* g[2]);
+// Same, reusing the buffers of p, returns false if invalid
+bool wl_graph_degree_partition_into(graph* g[2], wl_partition* p);
 graph graph_reverse(graph* g);
+// Same, reusing the buffers of h
+void graph_reverse_into(graph* g, graph* h);
 graph graph_apply_isomorphism(graph* g, int_array* iso);
 
 #endif
@@ -0,0 +1,407 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "index.h"
+
+#include "string.h"
+#include "assert.h"
+#include "stdio.h"
+#include "fcntl.h"
+#include "unistd.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "sys/file.h"
+
+#include "util.h"
+
+#define GRAPH_INDEX_PAD(n) (((n) + 7) & ~(size_t) 7)
+
+static inline uint64_t* graph_index_buckets(graph_index* x){
+  return (uint64_t*) (x->mapping + sizeof(graph_index_header));
+}
+
+static inline size_t graph_index_begin(uint32_t nbuckets){
+  return sizeof(graph_index_header) + (size_t) nbuckets * sizeof(uint64_t);
+}
+
+static inline size_t graph_index_record_length(int name_length, int size, int nedge){
+  return sizeof(graph_index_record) + GRAPH_INDEX_PAD((size_t) name_length + 1)
+    + GRAPH_INDEX_PAD(((size_t) size + 1 + nedge) * sizeof(int));
+}
+
+static inline size_t graph_index_length(graph_index_record* rec){
+  return graph_index_record_length(rec->name_length, rec->size, rec->nedge);
+}
+
+static inline graph_index_record* graph_index_at(graph_index* x, uint64_t offset){
+  return offset == 0 ? NULL : (graph_index_record*) (x->mapping + offset);
+}
+
+graph_index graph_index_empty(){
+  graph_index x;
+  x.fd           = -1;
+  x.lock         = -1;
+  x.path         = NULL;
+  x.mapping      = NULL;
+  x.mapping_size = 0;
+  return x;
+}
+
+bool graph_index_is_empty(graph_index* x){
+  assert(x != NULL);
+  return x->mapping == NULL;
+}
+
+// Maps at least size bytes, the mapping may extend past the end of the file
+bool graph_index_map(graph_index* x, size_t size){
+  if(x->mapping != NULL){
+    munmap(x->mapping, x->mapping_size);
+  }
+  void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, x->fd, 0);
+  if(mapping == MAP_FAILED){
+    x->mapping = NULL;
+    x->mapping_size = 0;
+    return false;
+  }
+  x->mapping      = mapping;
+  x->mapping_size = size;
+  return true;
+}
+
+// Header and empty buckets
+bool graph_index_init(int fd, uint32_t nbuckets){
+  graph_index_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GRAPH_INDEX_MAGIC, 4);
+  header.version  = GRAPH_INDEX_VERSION;
+  header.endian   = GRAPH_BINARY_ENDIAN;
+  header.canon    = CANON_VERSION;
+  header.nbuckets = nbuckets;
+  header.count    = 0;
+  header.next_id  = 0;
+  header.end      = graph_index_begin(nbuckets);
+  return ftruncate(fd, header.end) == 0
+    && pwrite(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header);
+}
+
+// Unmaps and closes the file of the index, not its lock
+void graph_index_detach(graph_index* x){
+  if(x->mapping != NULL){
+    munmap(x->mapping, x->mapping_size);
+  }
+  if(x->fd >= 0){
+    close(x->fd);
+  }
+  x->fd           = -1;
+  x->mapping      = NULL;
+  x->mapping_size = 0;
+}
+
+// Opens and maps x->path, initialized if it is empty, false if it isn't a valid index. Under the exclusive lock
+bool graph_index_attach(graph_index* x){
+  x->fd = open(x->path, O_RDWR | O_CREAT, 0644);
+  if(x->fd < 0){
+    return false;
+  }
+  struct stat st;
+  if(fstat(x->fd, &st) != 0 || (st.st_size == 0 && !graph_index_init(x->fd, GRAPH_INDEX_BUCKETS))
+     || fstat(x->fd, &st) != 0 || (size_t) st.st_size < sizeof(graph_index_header)
+     || !graph_index_map(x, st.st_size)){
+    graph_index_detach(x);
+    return false;
+  }
+  graph_index_header* header = graph_index_get_header(x);
+  if(memcmp(header->magic, GRAPH_INDEX_MAGIC, 4) != 0
+     || header->version != GRAPH_INDEX_VERSION
+     || header->endian != GRAPH_BINARY_ENDIAN
+     || header->canon != CANON_VERSION
+     || header->nbuckets == 0 || (header->nbuckets & (header->nbuckets - 1)) != 0
+     || header->end < graph_index_begin(header->nbuckets) || header->end > (uint64_t) st.st_size){
+    graph_index_detach(x);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * LOCK_SH to read the index, LOCK_EX to change it, false on error
+ * The file is mapped again if another process replaced it by compacting it, or appended past the mapping
+ */
+bool graph_index_lock(graph_index* x, int operation){
+  if(x->fd < 0 || flock(x->lock, operation) != 0){
+    return false;
+  }
+  struct stat a, b;
+  bool valid = fstat(x->fd, &a) == 0 && stat(x->path, &b) == 0;
+  if(valid && (a.st_dev != b.st_dev || a.st_ino != b.st_ino)){
+    graph_index_detach(x);
+    valid = graph_index_attach(x);
+  }else if(valid && graph_index_get_header(x)->end > x->mapping_size){
+    valid = graph_index_map(x, 2 * graph_index_get_header(x)->end);
+  }
+  if(!valid){
+    flock(x->lock, LOCK_UN);
+  }
+  return valid;
+}
+
+void graph_index_unlock(graph_index* x){
+  flock(x->lock, LOCK_UN);
+}
+
+graph_index graph_index_open(const char* path){
+  assert(path != NULL);
+  graph_index x = graph_index_empty();
+  size_t path_length = strlen(path);
+  char* lock = malloc(path_length + 6);
+  memcpy(lock, path, path_length);
+  memcpy(lock + path_length, ".lock", 6);
+  x.lock = open(lock, O_RDWR | O_CREAT, 0644);
+  free(lock);
+  x.path = strdup(path);
+  // Another process may be creating or compacting it
+  if(x.lock < 0 || flock(x.lock, LOCK_EX) != 0 || !graph_index_attach(&x)){
+    graph_index_close(&x);
+    return graph_index_empty();
+  }
+  graph_index_unlock(&x);
+  return x;
+}
+
+void graph_index_close(graph_index* x){
+  assert(x != NULL);
+  graph_index_detach(x);
+  if(x->lock >= 0){
+    close(x->lock);
+  }
+  free(x->path);
+  *x = graph_index_empty();
+}
+
+graph_index_record* graph_index_first(graph_index* x, uint64_t hash){
+  assert(x != NULL);
+  graph_index_header* header = graph_index_get_header(x);
+  return graph_index_at(x, graph_index_buckets(x)[hash & (header->nbuckets - 1)]);
+}
+
+graph_index_record* graph_index_next(graph_index* x, graph_index_record* rec){
+  assert(x != NULL && rec != NULL);
+  return graph_index_at(x, rec->next);
+}
+
+const char* graph_index_record_name(graph_index_record* rec){
+  return (const char*) (rec + 1);
+}
+
+graph graph_index_record_certificate(graph_index_record* rec){
+  int* data = (int*) ((char*) (rec + 1) + GRAPH_INDEX_PAD((size_t) rec->name_length + 1));
+  graph g = graph_empty();
+  g.size       = rec->size;
+  g.offsets    = data;
+  g.neighbours = data + rec->size + 1;
+  g.storage    = GRAPH_BORROWED;
+  return g;
+}
+
+// Record followed by its name and its certificate, next is left to the caller
+char* graph_index_record_new(int id, uint64_t hash, graph* g, const char* name, size_t* length){
+  int name_length = strlen(name);
+  int nedge = graph_edge_count(g);
+  *length = graph_index_record_length(name_length, g->size, nedge);
+  char* buffer = calloc(*length, 1);
+  graph_index_record* rec = (graph_index_record*) buffer;
+  rec->hash        = hash;
+  rec->id          = id;
+  rec->size        = g->size;
+  rec->nedge       = nedge;
+  rec->name_length = name_length;
+  memcpy(buffer + sizeof(graph_index_record), name, name_length);
+  int* data = (int*) (buffer + sizeof(graph_index_record) + GRAPH_INDEX_PAD((size_t) name_length + 1));
+  memcpy(data, g->offsets, (g->size + 1) * sizeof(int));
+  memcpy(data + g->size + 1, g->neighbours, nedge * sizeof(int));
+  return buffer;
+}
+
+// Under the exclusive lock
+int graph_index_append_locked(graph_index* x, canon_form* c, const char* name){
+  graph_index_header* header = graph_index_get_header(x);
+  int id = header->next_id;
+  size_t length;
+  char* buffer = graph_index_record_new(id, c->hash, &c->certificate, name, &length);
+  uint64_t* bucket = &graph_index_buckets(x)[c->hash & (header->nbuckets - 1)];
+  ((graph_index_record*) buffer)->next = *bucket;
+
+  // The record is written before being linked
+  uint64_t end = header->end;
+  bool written = pwrite(x->fd, buffer, length, end) == (ssize_t) length;
+  free(buffer);
+  if(!written){
+    return -1;
+  }
+  if(end + length > x->mapping_size){
+    if(!graph_index_map(x, 2 * (end + length))){
+      return -1;
+    }
+    header = graph_index_get_header(x);
+    bucket = &graph_index_buckets(x)[c->hash & (header->nbuckets - 1)];
+  }
+  *bucket = end;
+  header->end      = end + length;
+  header->count   += 1;
+  header->next_id += 1;
+  return id;
+}
+
+int graph_index_append(graph_index* x, canon_form* c, const char* name){
+  assert(x != NULL && c != NULL && name != NULL);
+  assert(!canon_form_is_empty(c));
+  if(!graph_index_lock(x, LOCK_EX)){
+    return -1;
+  }
+  int id = graph_index_append_locked(x, c, name);
+  graph_index_unlock(x);
+  return id;
+}
+
+int_array graph_index_lookup(graph_index* x, canon_form* c){
+  assert(x != NULL && c != NULL);
+  if(!graph_index_lock(x, LOCK_SH)){
+    return int_array_empty();
+  }
+  int_array ids = int_array_empty();
+  for(graph_index_record* rec = graph_index_first(x, c->hash); rec != NULL; rec = graph_index_next(x, rec)){
+    if(rec->hash != c->hash || (rec->flags & GRAPH_INDEX_REMOVED)){
+      continue;
+    }
+    graph certificate = graph_index_record_certificate(rec);
+    if(graph_compare(&certificate, &c->certificate) == 0){
+      int_array_append(&ids, rec->id);
+    }
+  }
+  graph_index_unlock(x);
+  // Chains are linked from the newest record
+  for(int i = 0, j = ids.size - 1; i < j; ++i, --j){
+    SWAP(int, ids.array[i], ids.array[j]);
+  }
+  return ids;
+}
+
+// Under the exclusive lock
+bool graph_index_remove_locked(graph_index* x, int id){
+  graph_index_header* header = graph_index_get_header(x);
+  for(uint64_t offset = graph_index_begin(header->nbuckets); offset < header->end; ){
+    graph_index_record* rec = graph_index_at(x, offset);
+    if(rec->id == id && !(rec->flags & GRAPH_INDEX_REMOVED)){
+      rec->flags |= GRAPH_INDEX_REMOVED;
+      header->count -= 1;
+      return true;
+    }
+    offset += graph_index_length(rec);
+  }
+  return false;
+}
+
+bool graph_index_remove(graph_index* x, int id){
+  assert(x != NULL);
+  if(!graph_index_lock(x, LOCK_EX)){
+    return false;
+  }
+  bool removed = graph_index_remove_locked(x, id);
+  graph_index_unlock(x);
+  return removed;
+}
+
+typedef struct graph_index_entry {
+  uint32_t bucket;
+  int32_t  id;
+  uint64_t offset;
+} graph_index_entry;
+
+int graph_index_entry_compare(const void* a, const void* b){
+  const graph_index_entry* ea = a;
+  const graph_index_entry* eb = b;
+  if(ea->bucket != eb->bucket){
+    return ea->bucket < eb->bucket ? -1 : 1;
+  }
+  return int_compare(ea->id, eb->id);
+}
+
+// Under the exclusive lock
+bool graph_index_compact_locked(graph_index* x){
+  graph_index_header* header = graph_index_get_header(x);
+  uint32_t nbuckets = GRAPH_INDEX_BUCKETS;
+  while(nbuckets < 2 * (uint64_t) header->count){
+    nbuckets *= 2;
+  }
+
+  // Records grouped by bucket, in insertion order inside a bucket
+  graph_index_entry* entries = malloc((header->count > 0 ? header->count : 1) * sizeof(graph_index_entry));
+  int count = 0;
+  for(uint64_t offset = graph_index_begin(header->nbuckets); offset < header->end; ){
+    graph_index_record* rec = graph_index_at(x, offset);
+    if(!(rec->flags & GRAPH_INDEX_REMOVED)){
+      assert(count < header->count);
+      entries[count].bucket = rec->hash & (nbuckets - 1);
+      entries[count].id     = rec->id;
+      entries[count].offset = offset;
+      count += 1;
+    }
+    offset += graph_index_length(rec);
+  }
+  qsort(entries, count, sizeof(graph_index_entry), graph_index_entry_compare);
+
+  // The new file replaces the old one once it is complete
+  size_t path_length = strlen(x->path);
+  char* tmp = malloc(path_length + 5);
+  memcpy(tmp, x->path, path_length);
+  memcpy(tmp + path_length, ".tmp", 5);
+  int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  bool valid = fd >= 0 && graph_index_init(fd, nbuckets);
+  uint64_t* buckets = calloc(nbuckets, sizeof(uint64_t));
+  uint64_t end = graph_index_begin(nbuckets);
+  for(int i = 0; valid && i < count; ++i){
+    graph_index_record* rec = graph_index_at(x, entries[i].offset);
+    size_t length = graph_index_length(rec);
+    char* buffer = malloc(length);
+    memcpy(buffer, rec, length);
+    ((graph_index_record*) buffer)->next = buckets[entries[i].bucket];
+    valid = pwrite(fd, buffer, length, end) == (ssize_t) length;
+    free(buffer);
+    buckets[entries[i].bucket] = end;
+    end += length;
+  }
+  if(valid){
+    graph_index_header h = *header;
+    h.nbuckets = nbuckets;
+    h.count    = count;
+    h.end      = end;
+    valid = pwrite(fd, &h, sizeof(h), 0) == (ssize_t) sizeof(h)
+      && pwrite(fd, buckets, nbuckets * sizeof(uint64_t), sizeof(h)) == (ssize_t) (nbuckets * sizeof(uint64_t))
+      && fsync(fd) == 0
+      && rename(tmp, x->path) == 0;
+  }
+  if(fd >= 0){
+    close(fd);
+  }
+  if(!valid){
+    unlink(tmp);
+  }
+  free(buckets);
+  free(entries);
+  free(tmp);
+  if(!valid){
+    return false;
+  }
+
+  graph_index_detach(x);
+  return graph_index_attach(x);
+}
+
+bool graph_index_compact(graph_index* x){
+  assert(x != NULL);
+  if(!graph_index_lock(x, LOCK_EX)){
+    return false;
+  }
+  bool valid = graph_index_compact_locked(x);
+  graph_index_unlock(x);
+  return valid;
+}
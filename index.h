@@ -0,0 +1,93 @@
+#ifndef ALGO_GISO_INDEX_H
+#define ALGO_GISO_INDEX_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "array.h"
+#include "graph.h"
+#include "canon.h"
+
+/*
+ * graph_index
+ *
+ * On-disk index of canonical certificates : certificate hash -> graph ids
+ *
+ * File layout (version 2), native byte order, every part aligned on 8 bytes :
+ *   graph_index_header, buckets[nbuckets] (offset of the first record of the chain, 0 if empty),
+ *   then the records, appended at the end of the file.
+ * A record is a graph_index_record followed by the name (padded), then the offsets[size + 1] and
+ * neighbours[nedge] of the certificate (padded).
+ *
+ * The file is mapped (MAP_SHARED) : a lookup only touches the bucket and the records of its chain.
+ * Appending writes the record at the end of the file, then links it at the head of its chain.
+ * Removing only marks the record, compaction rewrites the file without removed records, with a bucket
+ * count fitted to the number of records and the records of a chain stored next to each other.
+ *
+ * Several processes may use the same index : appending, removing and compacting hold an exclusive flock,
+ * lookups a shared one. The lock is taken on path.lock, since compaction replaces path by a new file.
+ * Once locked, a process maps the file again if another one compacted it or appended past its mapping.
+ */
+
+#define GRAPH_INDEX_MAGIC   "GIDX"
+#define GRAPH_INDEX_VERSION 2
+#define GRAPH_INDEX_BUCKETS 1024
+
+#define GRAPH_INDEX_REMOVED 1
+
+typedef struct graph_index_header {
+  char     magic[4];
+  uint32_t version;
+  uint32_t endian;
+  uint32_t canon;    // CANON_VERSION of the certificates
+  uint32_t nbuckets; // power of two
+  int32_t  count;    // records not removed
+  int32_t  next_id;
+  uint64_t end;      // end of the last record
+} graph_index_header;
+
+typedef struct graph_index_record {
+  uint64_t hash;
+  uint64_t next;     // offset of the next record of the chain, 0 if last
+  int32_t  id;
+  uint32_t flags;
+  int32_t  size;
+  int32_t  nedge;
+  uint32_t name_length;
+  uint32_t reserved;
+} graph_index_record;
+
+typedef struct graph_index {
+  int    fd;
+  int    lock;   // descriptor of path.lock
+  char*  path;
+  char*  mapping;
+  size_t mapping_size;
+} graph_index;
+
+graph_index graph_index_empty();
+bool graph_index_is_empty(graph_index* x);
+// Creates the file, and path.lock, if it doesn't exist, graph_index_empty() on error
+graph_index graph_index_open(const char* path);
+void graph_index_close(graph_index* x);
+
+static inline graph_index_header* graph_index_get_header(graph_index* x){
+  return (graph_index_header*) x->mapping;
+}
+
+// First record of the chain of hash, then the next ones, NULL at the end of the chain
+graph_index_record* graph_index_first(graph_index* x, uint64_t hash);
+graph_index_record* graph_index_next(graph_index* x, graph_index_record* rec);
+const char* graph_index_record_name(graph_index_record* rec);
+// Borrowed from the mapping, valid until the next append or compaction
+graph graph_index_record_certificate(graph_index_record* rec);
+
+// Id of the new record, -1 on error
+int graph_index_append(graph_index* x, canon_form* c, const char* name);
+// Ids of the records with the same certificate, in insertion order
+int_array graph_index_lookup(graph_index* x, canon_form* c);
+// O(size of the file), returns false if there is no such record
+bool graph_index_remove(graph_index* x, int id);
+bool graph_index_compact(graph_index* x);
+
+#endif
@@ -1,17 +1,28 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "stdio.h"
 #include "stdlib.h"
 #include "stdbool.h"
+#include "string.h"
 #include "math.h"
 #include "assert.h"
 #include "inttypes.h"
-#include "time.h"
+#include "unistd.h"
+#include "dirent.h"
+#include "sys/stat.h"
 
 #include "array.h"
 #include "util.h"
 #include "set.h"
 #include "graph.h"
 #include "partition.h"
+#include "reader.h"
 #include "wl_partition.h"
+#include "wl.h"
+#include "canon.h"
+#include "index.h"
+#include "automorphism.h"
+#include "wl_parallel.h"
 
 /*
  * Algorithm to test whether iso is a valid isomorphism between graphs a and b
@@ -25,12 +36,13 @@ bool test_isomorphism(const graph* a, const graph* b, int_array* iso){
   assert(a->size == iso->size);
 
   for(int i = 0; i < a->size; ++i){
-    if(a->array[i].size != b->array[iso->array[i]].size){
+    if(graph_degree(a, i) != graph_degree(b, iso->array[i])){
       return false;
     }
     
-    for(int j = 0; j < a->array[i].size; ++j){
-      if(!int_array_binary_search(&b->array[iso->array[i]], iso->array[a->array[i].array[j]])){
+    int* nb = graph_neighbours(a, i);
+    for(int j = 0; j < graph_degree(a, i); ++j){
+      if(!graph_has_edge(b, iso->array[i], iso->array[nb[j]])){
         return false;
       }
     }
@@ -100,6 +112,43 @@ int_array graph_isomorphism_1(graph* a, graph* b){
   return int_array_empty();
 }
 
+// Search of graph_isomorphism_2 : iso[0..i-1] is the image of the vertices [0..i-1] of a
+typedef struct permutation_search {
+  graph*    a;
+  graph*    b;
+  int_array iso;
+} permutation_search;
+
+bool permutation_backtrack(permutation_search* s, int i){
+  graph* a = s->a;
+  graph* b = s->b;
+  int* iso = s->iso.array;
+  if(i == a->size){
+    return test_isomorphism(a, b, &s->iso);
+  }
+  /*
+   * Remaining vertex in b are vertex iso[i..n-1]
+   */
+  for(int j = i; j < a->size; ++j){
+    SWAP(int, iso[i], iso[j]);
+    // Need to test new edges in the subgraph with vertices in [0..i]
+    if(graph_degree(a, i) == graph_degree(b, iso[i])){
+      bool valid = true;
+      int* nb = graph_neighbours(a, i);
+      for(int k = 0; k < graph_degree(a, i); ++k){
+        if(nb[k] <= i && !graph_has_edge(b, iso[i], iso[nb[k]])){
+          valid = false;
+        }
+      }
+      if(valid && permutation_backtrack(s, i+1)){
+        return true;
+      }
+    }
+    SWAP(int, iso[i], iso[j]);
+  }
+  return false;
+}
+
 // Iterates over all isomorphisms, with backtracing
 int_array graph_isomorphism_2(graph* a, graph* b){
   assert(a != NULL);
@@ -108,41 +157,106 @@ int_array graph_isomorphism_2(graph* a, graph* b){
     return int_array_empty();
   }
 
-  int_array iso = trivial_isomorphism(a->size);
-
-  bool backtrack(int i){
-    if(i == a->size){
-      return test_isomorphism(a, b, &iso);
-    }else{
-      /*
-       * Remaining vertex in b are vertex iso[i..n-1]
-       */
-      for(int j = i; j < a->size; ++j){
-        SWAP(int, iso.array[i], iso.array[j]);
-        // Need to test new edges in the subgraph with vertices in [0..i]
-        if(a->array[i].size == b->array[iso.array[i]].size){
-          bool valid = true;
-          for(int k = 0; k < a->array[i].size; ++k){
-            if(a->array[i].array[k] <= i && !int_array_binary_search(&b->array[iso.array[i]], iso.array[a->array[i].array[k]])){
-              valid = false;
-            }
-          }
-          if(valid && backtrack(i+1)){
-            return true;
-          }
-        }
+  permutation_search s = { a, b, trivial_isomorphism(a->size) };
+  if(permutation_backtrack(&s, 0)){
+    return s.iso;
+  }else{
+    int_array_free(&s.iso);
+    return int_array_empty();
+  }
+}
 
-        SWAP(int, iso.array[i], iso.array[j]);
-      }
+// Search of graph_isomorphism_partition : classes are mapped in the order of I, vertex by vertex
+// Frame d of the stack assigns the d-th vertex : vertex j of class I[i] of a is mapped to vertex k of that class in b
+typedef struct partition_frame {
+  int i;
+  int j;
+  int k;
+} partition_frame;
+
+typedef struct partition_search {
+  graph*           a;
+  graph*           b;
+  int_array_array* pa;
+  int_array_array* pb;
+  int_array        I;
+  int_array        iso;
+  bool*            done;
+  partition_frame* frames; // one per vertex of a
+} partition_search;
+
+// Classes by increasing size
+#define CLASS_SIZE_LESS(context, x, y) \
+  (((const int_array_array*) (context))->array[x].size < ((const int_array_array*) (context))->array[y].size)
+
+ARRAY_SORT_DEFINE(class_size_sort, int, CLASS_SIZE_LESS)
+
+// Maps the vertex of frame f to vertex k of its class, swapped to position j : false if an edge doesn't match
+bool partition_try(partition_search* s, partition_frame* f){
+  int* ca = s->pa->array[s->I.array[f->i]].array;
+  int* cb = s->pb->array[s->I.array[f->i]].array;
+  SWAP(int, cb[f->j], cb[f->k]);
+  int ai = ca[f->j];
+  int aj = cb[f->j];
+  s->iso.array[ai] = aj;
+  if(graph_degree(s->a, ai) != graph_degree(s->b, aj)){
+    return false;
+  }
+  int* nb = graph_neighbours(s->a, ai);
+  for(int l = 0; l < graph_degree(s->a, ai); ++l){
+    if(s->done[nb[l]] && !graph_has_edge(s->b, aj, s->iso.array[nb[l]])){
       return false;
     }
   }
- 
-  if(backtrack(0)){
-    return iso;
-  }else{
-    int_array_free(&iso);
-    return int_array_empty();
+  return true;
+}
+
+// Iterative : the stack holds one frame per vertex assigned, instead of one recursive call
+bool partition_backtrack(partition_search* s){
+  int_array_array* pa = s->pa;
+  int depth = 0;
+  int i = 0, j = 0;
+  while(true){
+    // Next vertex to assign
+    while(i < s->I.size && j == pa->array[s->I.array[i]].size){
+      i += 1;
+      j = 0;
+    }
+    if(i == s->I.size){
+      return true;
+    }
+    assert(depth < s->a->size);
+    partition_frame* f = &s->frames[depth];
+    f->i = i;
+    f->j = j;
+    f->k = j;
+    s->done[pa->array[s->I.array[i]].array[j]] = true;
+    depth += 1;
+    // Deepest frame with a valid vertex left
+    while(true){
+      int* cb = s->pb->array[s->I.array[f->i]].array;
+      int size = pa->array[s->I.array[f->i]].size;
+      bool valid = false;
+      while(f->k < size && !(valid = partition_try(s, f))){
+        SWAP(int, cb[f->j], cb[f->k]);
+        f->k += 1;
+      }
+      if(valid){
+        break;
+      }
+      s->done[pa->array[s->I.array[f->i]].array[f->j]] = false;
+      depth -= 1;
+      if(depth == 0){
+        return false;
+      }
+      // Undoes the choice of the parent and moves to its next vertex
+      f = &s->frames[depth - 1];
+      cb = s->pb->array[s->I.array[f->i]].array;
+      SWAP(int, cb[f->j], cb[f->k]);
+      f->k += 1;
+    }
+    i = f->i;
+    j = f->j + 1;
   }
 }
 
@@ -163,57 +277,25 @@ int_array graph_isomorphism_partition(graph* a, graph* b, partition* a_part, par
     }
   }
 
-  int_array I = trivial_isomorphism(pa.size);
-  int I_cmp(int a, int b){
-    return pa.array[a].size - pa.array[b].size;
-  }
-  int_array_sort(&I, I_cmp);
-
-  int_array iso = trivial_isomorphism(a->size);
-  bool done[a->size];
-  for(int i = 0; i < a->size; ++i){
-    done[i] = false;
-  }
-        
-  bool backtrack(int i, int j){
-    if(i == I.size){
-      return true;
-    }else if(j == pa.array[I.array[i]].size){
-      return backtrack(i+1, 0);
-    }else{
-      int ai = pa.array[I.array[i]].array[j];
-      done[ai] = true;
-      
-      for(int k = j; k < pa.array[I.array[i]].size; ++k){
-        SWAP(int, pb.array[I.array[i]].array[j], pb.array[I.array[i]].array[k]);
-        
-        int aj = pb.array[I.array[i]].array[j];
-        iso.array[ai] = aj;
-        
-        if(a->array[ai].size == b->array[aj].size){
-          bool valid = true;
-          for(int l = 0; l < a->array[ai].size; ++l){
-            if(done[a->array[ai].array[l]] && !int_array_binary_search(&b->array[aj], iso.array[a->array[i].array[l]])){
-              valid = false;
-            }
-          }
-          if(valid && backtrack(i, j+1)){
-            return true;
-          }
-        }
-        
-        SWAP(int, pb.array[I.array[i]].array[j], pb.array[I.array[i]].array[k]);
-      }
-      
-      done[ai] = false;
-      return false;
-    }
-  }
-
-  if(backtrack(0, 0)){
-    return iso;
+  partition_search s;
+  s.a    = a;
+  s.b    = b;
+  s.pa   = &pa;
+  s.pb   = &pb;
+  s.I    = trivial_isomorphism(pa.size);
+  class_size_sort(s.I.array, s.I.size, &pa);
+  s.iso  = trivial_isomorphism(a->size);
+  s.done   = calloc(a->size + 1, sizeof(bool));
+  s.frames = malloc((a->size + 1) * sizeof(partition_frame));
+
+  bool found = partition_backtrack(&s);
+  int_array_free(&s.I);
+  free(s.done);
+  free(s.frames);
+  if(found){
+    return s.iso;
   }else{
-    int_array_free(&iso);
+    int_array_free(&s.iso);
     return int_array_empty();
   }
 }
@@ -233,298 +315,613 @@ int_array graph_isomorphism_degree_partition(graph* a, graph* b){
   return iso;
 }
 
+void usage(char* name){
+  fprintf(stderr, "usage : %s [-s] [-f format] [-e engine] [-r refinement] [-t target] [-j threads] [-p threads] [-g] [-b | -m manifest | -o output -o output] [input input]\n", name);
+  fprintf(stderr, "        %s [-s] [-f format] [-r refinement] [-n nodes] -i index [-a directory] [-d id] [-c] [input ...]\n", name);
+  fprintf(stderr, "  -s : print statistics on stderr, every stable partition is checked for hash collisions,\n");
+  fprintf(stderr, "       and the wl search prints its progress every 2^20 nodes\n");
+  fprintf(stderr, "  -e : wl (default), search on the pair, or canon, comparison of canonical forms\n");
+  fprintf(stderr, "  -r : hopcroft (default), only the fragments but the largest one of a split cell refine the others,\n");
+  fprintf(stderr, "       naive, all the vertices of a split cell do, or exact, cells are split by neighbour counts\n");
+  fprintf(stderr, "       instead of hashes. Canonical forms don't depend on it\n");
+  fprintf(stderr, "  -t : cell individualized by the search : first (default), smallest, largest, joins, the one non trivially\n");
+  fprintf(stderr, "       joined to the most cells, or first-largest. The index always uses first\n");
+  fprintf(stderr, "  -j : number of threads of the wl search, 1 by default. Subtrees are shared by work stealing,\n");
+  fprintf(stderr, "       the first isomorphism found stops the other threads\n");
+  fprintf(stderr, "  -p : number of threads of the refinement of large cells outside of the search, 1 by default,\n");
+  fprintf(stderr, "       partitions are the same as with a single thread. Only with hopcroft and naive\n");
+  fprintf(stderr, "  -g : also print the automorphism group of each graph : group, index of the graph, order, its base 10\n");
+  fprintf(stderr, "       logarithm and number of generators, then the generators in cycle notation, one per line\n");
+  fprintf(stderr, "  -f : input format : matrix (default), list, edges, dimacs, graph6, sparse6 or binary\n");
+  fprintf(stderr, "  -b : batch mode, read pairs of graphs from stdin until the end of file\n");
+  fprintf(stderr, "  -m : batch mode, read pairs of paths from manifest, one pair per line\n");
+  fprintf(stderr, "  -o : write the two graphs in binary format instead of testing them\n");
+  fprintf(stderr, "  -i : certificate index, created if needed. Inputs are looked up in the index,\n");
+  fprintf(stderr, "       graphs are read from stdin until the end of file when there is nothing else to do\n");
+  fprintf(stderr, "  -a : add every file of directory to the index\n");
+  fprintf(stderr, "  -d : remove graph id from the index\n");
+  fprintf(stderr, "  -c : compact the index\n");
+  fprintf(stderr, "  -n : nodes of the search of a canonical form of the index before the graph is reported as failed,\n");
+  fprintf(stderr, "       0 (default) : no limit. The other graphs are still added or looked up\n");
+  fprintf(stderr, "  inputs default to stdin, binary inputs have to be files. Their lists are checked when loaded, in O(n + m)\n");
+  fprintf(stderr, "  in batch mode, each result is prefixed by the index of the pair and followed by its latency in seconds\n");
+}
+
 /*
- * update_neighbours
- *
- * Update neighbours in a partition when it is refined
+ * Reads a graph from path, or from r if path is NULL
+ * rg receives the stored reverse graph of binary inputs, graph_empty() otherwise
+ * bytes, if not NULL, is increased by the bytes parsed from path : binary inputs are mapped, not parsed
  */
-
-void update_neighbours(graph* g[2], graph* rg[2], wl_partition* p, int pi){
-  int psize = p->partition.array[pi][0].size;
-  
-  for(int k = 0; k < psize; ++k){
-    int k_[2] = { p->partition.array[pi][0].array[k],
-                  p->partition.array[pi][1].array[k] };
-    int_array* a_[2] = { &g[0]->array[k_[0]],
-                         &g[1]->array[k_[1]] };
-    int_array* ra_[2] = { &rg[0]->array[k_[0]],
-                          &rg[1]->array[k_[1]] };
-    // Mark neighbouring classes
-    for(int m = 0; m < a_[0]->size; ++m){
-      int_set_insert(&p->update_queue, p->elements[0].array[a_[0]->array[m]]);
+graph read_input(int format, char* path, reader* r, graph* rg, size_t* bytes){
+  *rg = graph_empty();
+  if(format == GRAPH_FORMAT_BINARY){
+    if(path == NULL){
+      return graph_empty();
     }
-    for(int m = 0; m < ra_[0]->size; ++m){
-      int_set_insert(&p->update_queue, p->elements[0].array[ra_[0]->array[m]]);
+    graph g = graph_load_binary(path, rg, true);
+    return g;
+  }
+  graph g;
+  if(path != NULL){
+    FILE* f = fopen(path, "r");
+    if(f == NULL){
+      return graph_empty();
     }
-    // Update hashes
-    TWICE(j){
-      for(int m = 0; m < a_[j]->size; ++m){
-        p->elements_hash[j].array[a_[j]->array[m]] += int_rotate(wl_hash_f(p->elements[j].array[k_[j]])) - int_rotate(wl_hash_f(pi));
-      }
+    reader fr = reader_new(f);
+    g = graph_read_format(&fr, format);
+    if(bytes != NULL){
+      *bytes += reader_position(&fr);
     }
-    TWICE(j) for(int m = 0; m < ra_[j]->size; ++m){
-      p->elements_hash[j].array[ra_[j]->array[m]] += wl_hash_f(p->elements[j].array[k_[j]]) - wl_hash_f(pi);
+    reader_free(&fr);
+    fclose(f);
+  }else{
+    g = graph_read_format(r, format);
+  }
+  return g;
+}
+
+#define ENGINE_WL    0
+#define ENGINE_CANON 1
+
+int_array graph_isomorphism_canon(wl_workspace* ws, graph* g[2], graph* rg[2], bool stats){
+  canon_form c[2];
+  TWICE(i){
+    canon_stats st;
+    c[i] = graph_canonical_form_workspace(ws, g[i], rg[i], &st);
+    if(stats){
+      fprintf(stderr, "canon %d : %ld nodes, %ld leaves, %ld pruned, depth %d, %ld automorphisms, %ld skipped, %ld backjumps, hash %016" PRIx64 "\n",
+              i, st.nodes, st.leaves, st.pruned, st.depth, st.automorphisms, st.skipped, st.backjumps, c[i].hash);
     }
   }
+  int_array iso = canon_form_isomorphism(&c[0], &c[1]);
+  TWICE(i) canon_form_free(&c[i]);
+  return iso;
 }
 
 /*
- * stable_partition
- *
- * Finds the maximum refinement of a partition of g
- * Returns false if p is an invalid partition, and true otherwise
- * Updates p with the new partition
- *
- * For a given vertex, we compute its signature in the graph g : the multiset of the partition classes of its neighbours
- * A hash of the multiset is actually computed instead of the multiset to avoid array sorting
- *
- * We inspect all classes of the given partition, spliting some classes into new classes until the partition can't be refined.
- * For each class, we split the class if it is possible
- * When a class is split, we remember we have to check its neighbour classes
- * 
+ * Prints the order of the automorphism group of g, in decimal and as a base 10 logarithm, the number of generators,
+ * then the generators in cycle notation, one per line
  */
-
-bool stable_partition(graph* g[2], graph* rg[2], wl_partition* p){
-  TWICE(i) assert(g[i] != NULL);
-  TWICE(i) assert(rg[i] != NULL);
-  assert(p != NULL);
-  assert(g[0]->size == g[1]->size);
-  assert(rg[0]->size == rg[1]->size);
-  assert(g[0]->size == rg[0]->size);
-  TWICE(i) assert(g[i]->size == p->elements[i].size);
-
-  // Compute the signature of vertex j in graph g when g is g[i] or rg[i]
-  int_array signature(graph* g, int i, int j){
-    int_array sig = int_array_new(g->array[j].size);
-    for(int k = 0; k < g->array[j].size; ++k){
-      sig.array[k] = p->elements[i].array[g->array[j].array[k]];
-    }
-    return sig;
+void print_group(wl_workspace* ws, graph* g, graph* rg, int i, bool stats){
+  wl_search_stats ss = ws->stats;
+  ws->stats.depth = 0;
+  double t = wall_time();
+  automorphism_group group = graph_automorphism_group_workspace(ws, g, rg);
+  t = wall_time() - t;
+  if(stats){
+    fprintf(stderr, "group %d : %ld nodes, %ld failures, depth %d, %ld automorphisms, %ld pruned, %.6f s\n",
+            i, ws->stats.nodes - ss.nodes, ws->stats.failures - ss.failures, ws->stats.depth,
+            ws->stats.automorphisms - ss.automorphisms, ws->stats.pruned - ss.pruned, t);
   }
-
-  while(!int_set_is_empty(&p->update_queue)){
-    int i = int_set_delete(&p->update_queue);
-    int psize = p->partition.array[i][0].size;
-    
-    if(p->partition.array[i][0].size != p->partition.array[i][1].size){
-      return false;
+  if(ss.depth > ws->stats.depth){
+    ws->stats.depth = ss.depth;
+  }
+  char* order = automorphism_group_order(&group);
+  printf("group %d %s %.6f %d\n", i, order, automorphism_group_order_log10(&group), group.generators.size);
+  free(order);
+  // gamma is the identity between generators
+  int_array gamma = trivial_isomorphism(g->size);
+  for(int k = 0; k < group.generators.size; ++k){
+    int_array* moved = &group.generators.array[k];
+    for(int j = 0; j < moved->size; j += 2){
+      gamma.array[moved->array[j]] = moved->array[j + 1];
     }
-    
-    if(psize > 0){
-      if(psize == 1){
-        // No refinement possible, still check if the partition is valid !
-        int a[2];
-        TWICE(j) a[j] = p->partition.array[i][j].array[0];
-        if(g[0]->array[a[0]].size != g[1]->array[a[1]].size
-           || rg[0]->array[a[0]].size != rg[1]->array[a[1]].size){
-          return false;
-        }
-        if(p->elements_hash[0].array[a[0]] != p->elements_hash[1].array[a[1]]){
-          return false;
-        }
-        int_array sig[2]; TWICE(j) {
-          sig[j] = signature(g[j], j, a[j]);
-          int_array_sort_less(&sig[j]);
-        }
-        int_array rsig[2]; TWICE(j) {
-          rsig[j] = signature(rg[j], j, a[j]);
-          int_array_sort_less(&rsig[j]);
-        }
-        void local_free(){
-          TWICE(j) {
-            int_array_free(&sig[j]);
-            int_array_free(&rsig[j]);
-          }
-        }
-        if(int_array_compare(&sig[0], &sig[1]) != 0
-           || int_array_compare(&rsig[0], &rsig[1]) != 0){
-          local_free();
-          return false;
-        }
-        local_free();
-        // Partition is valid from this node
-      }else{
-        // Partitioning items with different signatures
-
-        // if the partition is valid, sorting signatures of the partition's vertex in the two graph should give the same result
-        // we sort these using indices to know which elements should go in the same partition class
-        int_array I[2];
-        TWICE(k) {
-          I[k] = trivial_isomorphism(psize);
-          int I_cmp(int a, int b){
-            return int_compare(p->elements_hash[k].array[p->partition.array[i][k].array[a]],
-			       p->elements_hash[k].array[p->partition.array[i][k].array[b]]);
-          }
-          int_array_sort(&I[k], I_cmp);
-        }
-        
-        void local_free(){
-          TWICE(j) int_array_free(&I[j]);
-        }
-
-        // If a refinement is possible
-        if(p->elements_hash[0].array[p->partition.array[i][0].array[I[0].array[0]]] !=
-           p->elements_hash[0].array[p->partition.array[i][0].array[I[0].array[psize-1]]] ||
-	   p->elements_hash[1].array[p->partition.array[i][1].array[I[1].array[0]]] !=
-           p->elements_hash[1].array[p->partition.array[i][1].array[I[1].array[psize-1]]] ||
-	   p->elements_hash[0].array[p->partition.array[i][0].array[I[0].array[0]]] !=
-           p->elements_hash[1].array[p->partition.array[i][1].array[I[1].array[0]]]){
-          int j = 0;
-          while(j != psize){
-            if(p->elements_hash[0].array[p->partition.array[i][0].array[I[0].array[j]]] !=
-               p->elements_hash[1].array[p->partition.array[i][1].array[I[1].array[j]]]){
-              local_free();
-              return false;
-            }
-            int k[2]; TWICE(l) k[l] = j + 1;
-            TWICE(l) while(k[l] < psize &&
-                           p->elements_hash[l].array[p->partition.array[i][l].array[I[l].array[j]]] ==
-                           p->elements_hash[l].array[p->partition.array[i][l].array[I[l].array[k[l]]]]){
-              k[l] += 1;
-            }
-            if(k[0] != k[1]){
-              local_free();
-              return false;
-            }
-            int cls = wl_partition_new_class(p);
-
-            while(j != k[0]){
-              int el[2]; TWICE(l) el[l] = p->partition.array[i][l].array[I[l].array[j]];
-              wl_partition_set_class(p, cls, el);
-              j += 1;
-            }
-          }
-          update_neighbours(g, rg, p, i);
-	  TWICE(j) {
-            int_array_free(&p->partition.array[i][j]);
-            p->partition.array[i][j] = int_array_empty();
-          }
-        }
-        local_free();
+    assert(test_isomorphism(g, g, &gamma));
+    for(int j = 0; j < moved->size; j += 2){
+      int v = moved->array[j];
+      if(gamma.array[v] == v){
+        continue;
+      }
+      // Each cycle is printed from the first vertex moved, then restored
+      printf("(%d", v);
+      for(int w = gamma.array[v]; w != v; ){
+        printf(" %d", w);
+        int next = gamma.array[w];
+        gamma.array[w] = w;
+        w = next;
       }
+      gamma.array[v] = v;
+      printf(")");
     }
+    printf("\n");
   }
-  return true;
+  int_array_free(&gamma);
+  automorphism_group_free(&group);
 }
 
 /*
- * graph_isomorphism_WL
- * Weisfeiler-Lehman algorithm
+ * Tests a pair and prints the result
+ * threads : workers of the wl engine
+ * index < 0 : single pair mode, otherwise the index of the pair and the latency are printed
+ * group : the automorphism groups of both graphs follow
  */
-
-int_array graph_isomorphism_WL(graph* g[2]){
-  TWICE(i) assert(g[i] != NULL);
-  if(g[0]->size != g[1]->size){
-    return int_array_empty();
+void solve_pair(wl_workspace* ws, graph* g[2], graph* rg[2], int engine, int threads, bool stats, bool group, int index){
+  wl_refine_stats rs = ws->p.stats;
+  wl_search_stats ss = ws->stats;
+  arena_stats as = ws->p.arena.stats;
+  ws->stats.depth = 0;
+  double t = wall_time();
+  TWICE(i) graph_build_matrix(g[i], GRAPH_MATRIX_BUDGET);
+  int_array iso;
+  if(engine == ENGINE_CANON){
+    iso = graph_isomorphism_canon(ws, g, rg, stats);
+  }else if(threads > 1){
+    iso = graph_isomorphism_WL_parallel(ws, g, rg, threads);
+  }else{
+    iso = graph_isomorphism_WL_workspace(ws, g, rg);
   }
-
-  graph rg_[2]; TWICE(i) rg_[i] = graph_reverse(g[i]);
-  graph* rg[2] = { &rg_[0], &rg_[1] };
-  
-  bool backtrack(wl_partition* p, int depth){
-    if(!stable_partition(g, rg, p)){
-      return false;
-    }
-    
-    // TODO : better choice of i ?
-    // Smallest / largest class ?
-    int i = 0;
-    while(i < p->partition.size && p->partition.array[i][0].size <= 1){
-      i += 1;
-    }
-    
-    // 1 element / class : isomorphism
-    if(i == p->partition.size){
-      return true;
+  t = wall_time() - t;
+  if(stats){
+    fprintf(stderr, "refine : %ld refinements, %ld splits, %ld edges visited, %ld collisions\n",
+            ws->p.stats.refinements - rs.refinements, ws->p.stats.splits - rs.splits,
+            ws->p.stats.visits - rs.visits, ws->p.stats.collisions - rs.collisions);
+    fprintf(stderr, "arena : %zu bytes peak, %ld allocations, %ld releases, %d blocks\n",
+            ws->p.arena.stats.peak, ws->p.arena.stats.allocations - as.allocations,
+            ws->p.arena.stats.releases - as.releases, ws->p.arena.stats.blocks);
+    if(engine == ENGINE_WL){
+      fprintf(stderr, "search : %ld nodes, %ld failures, depth %d, %ld automorphisms, %ld pruned\n",
+              ws->stats.nodes - ss.nodes, ws->stats.failures - ss.failures, ws->stats.depth,
+              ws->stats.automorphisms - ss.automorphisms, ws->stats.pruned - ss.pruned);
     }
-    
-    for(int j = 0; j < p->partition.array[i][0].size; ++j){
-      wl_partition p_ = wl_partition_copy(p);
+  }
+  if(ss.depth > ws->stats.depth){
+    ws->stats.depth = ss.depth;
+  }
+  bool found = iso.size != 0 || (g[0]->size == 0 && g[1]->size == 0);
+  if(index >= 0){
+    printf("%d %s %.6f\n", index, found ? "oui" : "non", t);
+  }else{
+    printf("%s\n", found ? "oui" : "non");
+  }
+  if(found){
+    for(int i = 0; i < iso.size; ++i){
+      printf("%d ", iso.array[i]);
+    } printf("\n");
+    assert(test_isomorphism(g[0], g[1], &iso));
+    int_array_free(&iso);
+  }
+  if(group){
+    TWICE(i) print_group(ws, g[i], rg[i], i, stats);
+  }
+  if(index >= 0){
+    fflush(stdout);
+  }
+}
 
-      int cls = wl_partition_new_class(&p_);
-      int a[2];
+// Reverse graphs may borrow the mapping of g
+void free_pair(graph g[2], graph rg[2]){
+  TWICE(i) graph_free(&rg[i]);
+  TWICE(i) graph_free(&g[i]);
+}
 
-      a[0] = int_array_back(&p_.partition.array[i][0]);
-      int_array_remove_back(&p_.partition.array[i][0]);
+/*
+ * Certificate index
+ * Adding prints the id of the graph followed by the ids of the graphs of the index isomorphic to it,
+ * looking up prints oui followed by these ids, or non
+ */
 
-      a[1] = p_.partition.array[i][1].array[j];
-      p_.partition.array[i][1].array[j] = int_array_back(&p_.partition.array[i][1]);
-      int_array_remove_back(&p_.partition.array[i][1]);
+/*
+ * Canonical form of the graph in path, or in r if path is NULL, empty form on error
+ * exceeded is set when the graph was read but its search needed more than ws->budget nodes
+ */
+canon_form index_canonical_form(wl_workspace* ws, int format, char* path, reader* r, bool* exceeded){
+  graph g, rg;
+  g = read_input(format, path, r, &rg, NULL);
+  *exceeded = false;
+  if(graph_is_empty(&g)){
+    graph_free(&rg);
+    return canon_form_empty();
+  }
+  canon_form c = graph_canonical_form_workspace(ws, &g, &rg, NULL);
+  *exceeded = canon_form_is_empty(&c);
+  graph_free(&rg);
+  graph_free(&g);
+  return c;
+}
 
-      wl_partition_set_class(&p_, cls, a);
+void index_print_ids(int_array* ids){
+  for(int i = 0; i < ids->size; ++i){
+    printf(" %d", ids->array[i]);
+  }
+  printf("\n");
+}
 
-      // For all neighbours of the old class
-      for(int k = 0; k < p->partition.array[i][0].size; ++k){
-        int k_[2] = { p->partition.array[i][0].array[k],
-                      p->partition.array[i][1].array[k] };
-        for(int m = 0; m < g[0]->array[k_[0]].size; ++m){
-          int_set_insert(&p_.update_queue, p->elements[0].array[g[0]->array[k_[0]].array[m]]);
-        }
-        for(int m = 0; m < rg[0]->array[k_[0]].size; ++m){
-          int_set_insert(&p_.update_queue, p->elements[0].array[rg[0]->array[k_[0]].array[m]]);
-        }
-      }
-      // For all neighbours of the new class
-      TWICE(j) for(int m = 0; m < g[j]->array[a[j]].size; ++m){
-        p_.elements_hash[j].array[g[j]->array[a[j]].array[m]] += int_rotate(wl_hash_f(p_.elements[j].array[a[j]])) - int_rotate(wl_hash_f(i));
-      }
-      TWICE(j) for(int k = 0; k < rg[j]->array[a[j]].size; ++k){
-        p_.elements_hash[j].array[rg[j]->array[a[j]].array[k]] += wl_hash_f(p_.elements[j].array[a[j]]) - wl_hash_f(i);
-      }
-      
-      if(backtrack(&p_, depth+1)){
-        SWAP(wl_partition, p_, *p)
-        wl_partition_free(&p_);
-        return true;
+int compare_names(const void* a, const void* b){
+  return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+// Regular files of directory, in lexicographic order
+bool index_add_directory(graph_index* x, wl_workspace* ws, int format, char* directory){
+  DIR* dir = opendir(directory);
+  if(dir == NULL){
+    fprintf(stderr, "cannot open %s\n", directory);
+    return false;
+  }
+  int count = 0, capacity = 16;
+  char** paths = malloc(capacity * sizeof(char*));
+  struct dirent* entry;
+  while((entry = readdir(dir)) != NULL){
+    if(entry->d_name[0] == '.'){
+      continue;
+    }
+    size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+    char* path = malloc(length);
+    snprintf(path, length, "%s/%s", directory, entry->d_name);
+    struct stat st;
+    if(stat(path, &st) != 0 || !S_ISREG(st.st_mode)){
+      free(path);
+      continue;
+    }
+    if(count == capacity){
+      capacity *= 2;
+      paths = realloc(paths, capacity * sizeof(char*));
+    }
+    paths[count] = path;
+    count += 1;
+  }
+  closedir(dir);
+  qsort(paths, count, sizeof(char*), compare_names);
+
+  bool valid = true;
+  for(int i = 0; i < count; ++i){
+    bool exceeded;
+    canon_form c = index_canonical_form(ws, format, paths[i], NULL, &exceeded);
+    if(canon_form_is_empty(&c)){
+      // The other files are still added
+      fprintf(stderr, exceeded ? "node budget exceeded on %s\n" : "invalid input %s\n", paths[i]);
+      valid = false;
+    }else{
+      int_array ids = graph_index_lookup(x, &c);
+      int id = graph_index_append(x, &c, paths[i]);
+      if(id < 0){
+        fprintf(stderr, "cannot write index\n");
+        valid = false;
+        i = count;
       }else{
-        wl_partition_free(&p_);
+        printf("%d %s", id, paths[i]);
+        index_print_ids(&ids);
       }
+      int_array_free(&ids);
     }
+    canon_form_free(&c);
+    free(paths[i]);
+  }
+  free(paths);
+  return valid;
+}
 
+bool index_lookup(graph_index* x, wl_workspace* ws, int format, char* path, reader* r, bool* exceeded){
+  canon_form c = index_canonical_form(ws, format, path, r, exceeded);
+  if(canon_form_is_empty(&c)){
     return false;
   }
+  int_array ids = graph_index_lookup(x, &c);
+  printf("%s", ids.size != 0 ? "oui" : "non");
+  index_print_ids(&ids);
+  int_array_free(&ids);
+  canon_form_free(&c);
+  return true;
+}
 
-  wl_partition p = wl_graph_degree_partition(g);
-  
-  void local_free(){
-    wl_partition_free(&p);
-    TWICE(i) graph_free(rg[i]);
+int index_main(char* path, int format, int refine, long budget, char* directory, int removed, bool compact,
+               char** inputs, int ninputs, bool stats){
+  graph_index x = graph_index_open(path);
+  if(graph_index_is_empty(&x)){
+    fprintf(stderr, "cannot open index %s\n", path);
+    return 1;
   }
-
-  if(backtrack(&p, 0)){
-    int_array iso = int_array_new(g[0]->size);
-    for(int i = 0; i < p.partition.size; ++i) if(p.partition.array[i][0].size != 0){
-      iso.array[p.partition.array[i][0].array[0]] = p.partition.array[i][1].array[0];
+  wl_workspace ws = wl_workspace_new();
+  ws.p.refine = refine;
+  ws.p.check  = stats;
+  ws.budget   = budget;
+  int status = 0;
+  double t = wall_time();
+  if(directory != NULL && !index_add_directory(&x, &ws, format, directory)){
+    status = 1;
+  }
+  if(removed >= 0 && !graph_index_remove(&x, removed)){
+    fprintf(stderr, "no graph %d in the index\n", removed);
+    status = 1;
+  }
+  for(int i = 0; i < ninputs; ++i){
+    bool exceeded;
+    if(!index_lookup(&x, &ws, format, inputs[i], NULL, &exceeded)){
+      fprintf(stderr, exceeded ? "node budget exceeded on %s\n" : "invalid input %s\n", inputs[i]);
+      status = 1;
     }
-    local_free();
-    return iso;
-  }else{
-    local_free();
-    return int_array_empty();
   }
+  if(directory == NULL && removed < 0 && !compact && ninputs == 0){
+    reader r = reader_new(stdin);
+    while(reader_skip_spaces(&r)){
+      bool exceeded;
+      if(!index_lookup(&x, &ws, format, NULL, &r, &exceeded)){
+        status = 1;
+        if(exceeded){
+          fprintf(stderr, "node budget exceeded\n");
+          continue;
+        }
+        // The stream can't be resynchronized
+        fprintf(stderr, "invalid input\n");
+        break;
+      }
+    }
+    reader_free(&r);
+  }
+  if(compact && !graph_index_compact(&x)){
+    fprintf(stderr, "cannot compact index %s\n", path);
+    status = 1;
+  }
+  if(stats && !graph_index_is_empty(&x)){
+    graph_index_header* header = graph_index_get_header(&x);
+    fprintf(stderr, "index : %d graphs, %u buckets, %" PRIu64 " bytes, %.6f s\n",
+            header->count, header->nbuckets, header->end, wall_time() - t);
+  }
+  graph_index_close(&x);
+  wl_workspace_free(&ws);
+  return status;
 }
 
-int main(int argc __attribute__((unused)), char** argv __attribute__((unused))){
-  srand(time(NULL));
+int main(int argc, char** argv){
+  bool stats = false, batch = false, group = false;
+  int format = GRAPH_FORMAT_MATRIX;
+  int engine = ENGINE_WL;
+  int refine = WL_REFINE_HOPCROFT;
+  int target = WL_TARGET_FIRST;
+  int threads = 1;
+  int refine_threads = 1;
+  char* output[2] = { NULL, NULL };
+  int noutput = 0;
+  char* manifest = NULL;
+  char* index_path = NULL;
+  char* directory = NULL;
+  int removed = -1;
+  bool compact = false;
+  long budget = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "sf:e:r:t:j:p:go:bm:i:a:d:cn:")) != -1){
+    switch(opt){
+    case 's':
+      stats = true;
+      break;
+    case 'f':
+      if((format = graph_format_from_name(optarg)) < 0){
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'e':
+      if(strcmp(optarg, "wl") == 0){
+        engine = ENGINE_WL;
+      }else if(strcmp(optarg, "canon") == 0){
+        engine = ENGINE_CANON;
+      }else{
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'r':
+      if(strcmp(optarg, "hopcroft") == 0){
+        refine = WL_REFINE_HOPCROFT;
+      }else if(strcmp(optarg, "naive") == 0){
+        refine = WL_REFINE_NAIVE;
+      }else if(strcmp(optarg, "exact") == 0){
+        refine = WL_REFINE_EXACT;
+      }else{
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 't':
+      if((target = wl_target_from_name(optarg)) < 0){
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'j':
+      if((threads = atoi(optarg)) < 1){
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'p':
+      if((refine_threads = atoi(optarg)) < 1){
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'g':
+      group = true;
+      break;
+    case 'o':
+      if(noutput == 2){
+        usage(argv[0]);
+        return 1;
+      }
+      output[noutput] = optarg;
+      noutput += 1;
+      break;
+    case 'b':
+      batch = true;
+      break;
+    case 'm':
+      manifest = optarg;
+      break;
+    case 'i':
+      index_path = optarg;
+      break;
+    case 'a':
+      directory = optarg;
+      break;
+    case 'd':
+      if((removed = atoi(optarg)) < 0){
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'c':
+      compact = true;
+      break;
+    case 'n':
+      if((budget = atol(optarg)) < 0){
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if(index_path != NULL){
+    if(batch || manifest != NULL || noutput != 0){
+      usage(argv[0]);
+      return 1;
+    }
+    return index_main(index_path, format, refine, budget, directory, removed, compact, argv + optind, argc - optind,
+                      stats);
+  }
+  if(directory != NULL || removed >= 0 || compact || budget != 0){
+    usage(argv[0]);
+    return 1;
+  }
+  if((argc - optind != 0 && argc - optind != 2) || (noutput != 0 && noutput != 2)
+     || ((batch || manifest != NULL) && (noutput != 0 || argc - optind != 0))){
+    usage(argv[0]);
+    return 1;
+  }
   // Entrée
-  graph a = graph_read_matrix();
-  graph b = graph_read_matrix();
-  // Appel de l'algorithme
-  int_array iso;
-  graph* g[2] = { &a, &b };
-
-  if((iso = graph_isomorphism_WL(g)).size != 0){
-    printf("oui\n");
-    for(int i = 0; i < a.size; ++i){
-      printf("%d ", iso.array[i]);
-    } printf("\n");
-    assert(test_isomorphism(&a, &b, &iso));
-    int_array_free(&iso);
+  reader r = reader_new(stdin);
+  wl_workspace ws = wl_workspace_new();
+  ws.p.refine = refine;
+  ws.p.check  = stats;
+  ws.target   = target;
+  ws.report   = stats ? 1L << 20 : 0;
+  if(refine_threads > 1 && (ws.p.pool = thread_pool_new(refine_threads)) == NULL){
+    fprintf(stderr, "cannot create %d threads\n", refine_threads);
+  }
+  graph g[2], rg[2];
+  graph* g_[2] = { &g[0], &g[1] };
+  graph* rg_[2] = { &rg[0], &rg[1] };
+  int status = 0;
+
+  if(batch || manifest != NULL){
+    reader mr;
+    if(manifest != NULL){
+      FILE* f = fopen(manifest, "r");
+      if(f == NULL){
+        fprintf(stderr, "cannot open %s\n", manifest);
+        reader_free(&r);
+        return 1;
+      }
+      mr = reader_new(f);
+    }
+    double parse = 0., total = wall_time();
+    int index = 0;
+    while(true){
+      double t = wall_time();
+      if(manifest != NULL){
+        if(!reader_skip_spaces(&mr)){
+          break;
+        }
+        // Two paths separated by blanks
+        size_t length;
+        const char* line = reader_line(&mr, &length);
+        char* paths = malloc(length + 1);
+        memcpy(paths, line, length);
+        paths[length] = '\0';
+        char* path[2];
+        path[0] = strtok(paths, " \t");
+        path[1] = strtok(NULL, " \t");
+        TWICE(i) g[i] = path[1] != NULL ? read_input(format, path[i], NULL, &rg[i], NULL) : graph_empty();
+        if(path[1] == NULL){
+          TWICE(i) rg[i] = graph_empty();
+        }
+        free(paths);
+      }else{
+        if(!reader_skip_spaces(&r)){
+          break;
+        }
+        TWICE(i) g[i] = read_input(format, NULL, &r, &rg[i], NULL);
+      }
+      parse += wall_time() - t;
+      if(graph_is_empty(&g[0]) || graph_is_empty(&g[1])){
+        fprintf(stderr, "invalid input for pair %d\n", index);
+        free_pair(g, rg);
+        status = 1;
+        if(manifest == NULL){
+          // The stream can't be resynchronized
+          break;
+        }
+      }else{
+        solve_pair(&ws, g_, rg_, engine, threads, stats, group, index);
+        free_pair(g, rg);
+      }
+      index += 1;
+    }
+    if(stats){
+      total = wall_time() - total;
+      fprintf(stderr, "batch : %d pairs in %.6f s, %.6f s parsing\n", index, total, parse);
+    }
+    if(manifest != NULL){
+      fclose(mr.file);
+      reader_free(&mr);
+    }
   }else{
-    printf("non\n");
+    bool paths = argc - optind == 2;
+    size_t n = 0;
+    double t = wall_time();
+    TWICE(i) g[i] = read_input(format, paths ? argv[optind + i] : NULL, &r, &rg[i], &n);
+    t = wall_time() - t;
+    if(stats){
+      if(!paths){
+        n = reader_position(&r);
+      }
+      if(n != 0){
+        fprintf(stderr, "parse : %zu bytes in %.6f s, %.0f bytes/s\n", n, t, t > 0 ? n / t : 0.);
+      }else{
+        fprintf(stderr, "parse : %.6f s\n", t);
+      }
+    }
+    if(graph_is_empty(&g[0]) || graph_is_empty(&g[1])){
+      fprintf(stderr, "invalid input\n");
+      status = 1;
+    }else if(noutput == 2){
+      TWICE(i) if(graph_is_empty(&rg[i])){
+        rg[i] = graph_reverse(&g[i]);
+      }
+      if(!graph_write_binary(&g[0], &rg[0], output[0]) || !graph_write_binary(&g[1], &rg[1], output[1])){
+        fprintf(stderr, "cannot write output\n");
+        status = 1;
+      }
+    }else{
+      // Appel de l'algorithme
+      solve_pair(&ws, g_, rg_, engine, threads, stats, group, -1);
+    }
+    // Cleanup
+    free_pair(g, rg);
   }
-  // Cleanup
-  graph_free(&a);
-  graph_free(&b);
-  return 0;
+  reader_free(&r);
+  thread_pool_free(ws.p.pool);
+  wl_workspace_free(&ws);
+  return status;
 }
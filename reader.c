@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "reader.h"
+
+#include "errno.h"
+#include "unistd.h"
+
+reader reader_new(FILE* file){
+  reader r;
+  r.file       = file;
+  r.bufferSize = READER_BLOCK_SIZE;
+  r.buffer     = malloc(r.bufferSize);
+  r.begin      = 0;
+  r.end        = 0;
+  r.consumed   = 0;
+  r.eof        = false;
+  return r;
+}
+
+void reader_free(reader* r){
+  assert(r != NULL);
+  if(r->buffer){
+    free(r->buffer);
+  }
+}
+
+size_t reader_ensure(reader* r, size_t n){
+  assert(r != NULL);
+  while(r->end - r->begin < n && !r->eof){
+    // Move unread bytes to the front, grow the buffer if a single request doesn't fit
+    if(r->begin != 0){
+      memmove(r->buffer, r->buffer + r->begin, r->end - r->begin);
+      r->consumed += r->begin;
+      r->end      -= r->begin;
+      r->begin     = 0;
+    }
+    if(r->bufferSize - r->end < READER_BLOCK_SIZE && r->bufferSize < n + READER_BLOCK_SIZE){
+      r->bufferSize = n + READER_BLOCK_SIZE;
+      r->buffer     = realloc(r->buffer, r->bufferSize);
+    }
+    // read returns what is available, so pipes that stay open are not waited for
+    ssize_t k = read(fileno(r->file), r->buffer + r->end, r->bufferSize - r->end);
+    if(k < 0 && errno == EINTR){
+      continue;
+    }
+    if(k <= 0){
+      r->eof = true;
+    }else{
+      r->end += k;
+    }
+  }
+  return r->end - r->begin;
+}
+
+bool reader_skip_spaces(reader* r){
+  while(true){
+    int c = reader_peek(r);
+    if(c == EOF){
+      return false;
+    }
+    if(!reader_is_space(c)){
+      return true;
+    }
+    r->begin += 1;
+  }
+}
+
+void reader_skip_line(reader* r){
+  int c;
+  while((c = reader_getc(r)) != EOF && c != '\n');
+}
+
+void reader_skip_comments(reader* r, const char* prefixes){
+  while(reader_skip_spaces(r) && reader_peek(r) != '\0' && strchr(prefixes, reader_peek(r)) != NULL){
+    reader_skip_line(r);
+  }
+}
+
+const char* reader_line(reader* r, size_t* length){
+  assert(r != NULL && length != NULL);
+  size_t searched = 0;
+  char* eol;
+  while((eol = memchr(r->buffer + r->begin + searched, '\n', r->end - r->begin - searched)) == NULL){
+    searched = r->end - r->begin;
+    if(reader_ensure(r, searched + 1) == searched){
+      break;
+    }
+  }
+  const char* line = r->buffer + r->begin;
+  size_t n = eol != NULL ? (size_t) (eol - line) : r->end - r->begin;
+  r->begin += (eol != NULL) ? n + 1 : n;
+  if(n > 0 && line[n - 1] == '\r'){
+    n -= 1;
+  }
+  *length = n;
+  return line;
+}
+
+bool reader_int(reader* r, int* value){
+  assert(r != NULL && value != NULL);
+  if(!reader_skip_spaces(r)){
+    return false;
+  }
+  bool negative = false;
+  if(reader_peek(r) == '-'){
+    negative = true;
+    r->begin += 1;
+  }
+  int c = reader_peek(r);
+  if(c < '0' || c > '9'){
+    return false;
+  }
+  long v = 0;
+  while((c = reader_peek(r)) >= '0' && c <= '9'){
+    v = 10 * v + (c - '0');
+    r->begin += 1;
+  }
+  *value = negative ? -v : v;
+  return true;
+}
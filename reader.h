@@ -0,0 +1,75 @@
+#ifndef ALGO_GISO_READER_H
+#define ALGO_GISO_READER_H
+
+#include "stdlib.h"
+#include "stdio.h"
+#include "stdbool.h"
+#include "string.h"
+#include "assert.h"
+
+/*
+ * Buffered input : the file is read in large blocks, parsers work directly on the buffer
+ * Unread bytes are buffer[begin .. end - 1]
+ */
+
+#define READER_BLOCK_SIZE (1 << 20)
+
+typedef struct reader {
+  FILE*  file;
+  char*  buffer;
+  size_t bufferSize;
+  size_t begin;
+  size_t end;
+  size_t consumed; // bytes consumed before buffer[0]
+  bool   eof;
+} reader;
+
+reader reader_new(FILE* file);
+void reader_free(reader* r);
+// Makes at least n bytes available unless the end of file is reached, returns the number of available bytes
+size_t reader_ensure(reader* r, size_t n);
+// Skips blanks, returns false at the end of file
+bool reader_skip_spaces(reader* r);
+// Skips the current line
+void reader_skip_line(reader* r);
+// Skips blanks and lines starting with one of the prefixes
+void reader_skip_comments(reader* r, const char* prefixes);
+// Consumes the current line and returns it without its end of line, valid until the next call on r
+const char* reader_line(reader* r, size_t* length);
+bool reader_int(reader* r, int* value);
+
+static inline const char* reader_data(reader* r){
+  return r->buffer + r->begin;
+}
+
+static inline void reader_advance(reader* r, size_t n){
+  assert(r->begin + n <= r->end);
+  r->begin += n;
+}
+
+// Next byte, EOF at the end of file
+static inline int reader_peek(reader* r){
+  if(r->begin == r->end && reader_ensure(r, 1) == 0){
+    return EOF;
+  }
+  return (unsigned char) r->buffer[r->begin];
+}
+
+static inline int reader_getc(reader* r){
+  int c = reader_peek(r);
+  if(c != EOF){
+    r->begin += 1;
+  }
+  return c;
+}
+
+// Total number of bytes consumed by parsers
+static inline size_t reader_position(reader* r){
+  return r->consumed + r->begin;
+}
+
+static inline bool reader_is_space(int c){
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+#endif
@@ -109,72 +109,56 @@ void splay_zigzag(set_node** p, bool d){
 }
 
 
-// True if the element was inserted
-bool int_set_insert(int_set* s, int value){
-  assert(s != NULL);
-  bool rt;
-  bool insert_(set_node** p, set_node** s, bool d){
-    if(*s == NULL){
-      rt = true;
-      *s = make_set_node(value, NULL, NULL);
-      return true;
-    }else if(value == (*s)->value){
-      rt = false;
-      return true;
-    }else{
-      bool d_ = (value >= (*s)->value);
-      if(insert_(s, d_?&(*s)->r:&(*s)->l, d_)){
-        if(p == NULL){
-          splay_zig(s, d_);
-        }else if(d == d_){
-          splay_zigzig(p, d);
-        }else{
-          splay_zigzag(p, d);
-        }
-        return false;
+// Inserts value below *s, whose parent p is reached from its child d (right if true) : true if *s must be splayed
+// by the caller, inserted tells whether value was new
+bool int_set_insert_below(set_node** p, set_node** s, bool d, int value, bool* inserted){
+  if(*s == NULL){
+    *inserted = true;
+    *s = make_set_node(value, NULL, NULL);
+    return true;
+  }else if(value == (*s)->value){
+    *inserted = false;
+    return true;
+  }else{
+    bool d_ = (value >= (*s)->value);
+    if(int_set_insert_below(s, d_?&(*s)->r:&(*s)->l, d_, value, inserted)){
+      if(p == NULL){
+        splay_zig(s, d_);
+      }else if(d == d_){
+        splay_zigzig(p, d);
       }else{
-        return true;
+        splay_zigzag(p, d);
       }
+      return false;
+    }else{
+      return true;
     }
   }
-  insert_(NULL, s, false);
-  return rt;
 }
 
+// True if the element was inserted
+bool int_set_insert(int_set* s, int value){
+  assert(s != NULL);
+  bool inserted;
+  int_set_insert_below(NULL, s, false, value, &inserted);
+  return inserted;
+}
+
+// Removes the minimum : the processing order only depends on the content of the set
 int int_set_delete(int_set* s){
   assert(s != NULL);
   assert(*s != NULL); // Not empty
-  int rt;
-  bool delete_(set_node** p, set_node** s, bool d){
-    if((*s)->r == NULL){
-      rt = (*s)->value;
-      set_node* s_ = *s;
-      *s = (*s)->l;
-      free(s_);
-      return false;
-    }else if((*s)->l == NULL){
-      rt = (*s)->value;
-      set_node* s_ = *s;
-      *s = (*s)->r;
-      free(s_);
-      return false;
-    }else{
-      bool d_ = !d;
-      if(delete_(s, d_?&(*s)->r:&(*s)->l, d_)){
-        if(p == NULL){
-          splay_zig(s, d_);
-        }else if(d == d_){
-          splay_zigzig(p, d);
-        }else{
-          splay_zigzag(p, d);
-        }
-        return false;
-      }else{
-        return true;
-      }
-    }
+  // Splay the minimum to the root along the left spine
+  while((*s)->l != NULL && (*s)->l->l != NULL){
+    splay_zigzig(s, false);
+  }
+  if((*s)->l != NULL){
+    splay_zig(s, false);
   }
-  delete_(NULL, s, false);
+  int rt = (*s)->value;
+  set_node* s_ = *s;
+  *s = (*s)->r;
+  free(s_);
   return rt;
 }
 
@@ -18,6 +18,7 @@ int_set int_set_copy(int_set* s);
 void int_set_print(int_set* s);
 bool int_set_is_empty(int_set* s);
 bool int_set_insert(int_set* s, int v);
+// Removes and returns the minimum
 int int_set_delete(int_set* s);
 void int_set_map_monotonous(int_set* s, int(*f)(int));
 
@@ -0,0 +1,119 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "thread_pool.h"
+
+#include "pthread.h"
+#include "assert.h"
+
+typedef struct thread_pool_worker {
+  thread_pool* pool;
+  int          id;
+  pthread_t    thread;
+} thread_pool_worker;
+
+struct thread_pool {
+  int                 threads;
+  thread_pool_worker* workers;  // threads 1 ... threads - 1
+  pthread_mutex_t     lock;
+  pthread_cond_t      start;
+  pthread_cond_t      done;
+  long                generation; // calls of thread_pool_for
+  int                 running;    // workers still in the current call
+  bool                quit;
+  thread_pool_f       f;
+  void*               context;
+  int                 count;
+};
+
+void thread_pool_range(thread_pool* pool, int t){
+  int begin = (int) ((long) pool->count * t / pool->threads);
+  int end   = (int) ((long) pool->count * (t + 1) / pool->threads);
+  pool->f(pool->context, t, begin, end);
+}
+
+void* thread_pool_run(void* arg){
+  thread_pool_worker* w = arg;
+  thread_pool* pool = w->pool;
+  long seen = 0;
+  while(true){
+    pthread_mutex_lock(&pool->lock);
+    while(pool->generation == seen && !pool->quit){
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if(pool->quit){
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    thread_pool_range(pool, w->id);
+    pthread_mutex_lock(&pool->lock);
+    pool->running -= 1;
+    if(pool->running == 0){
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+thread_pool* thread_pool_new(int threads){
+  assert(threads >= 1);
+  thread_pool* pool = malloc(sizeof(thread_pool));
+  pool->threads    = threads;
+  pool->workers    = malloc(threads * sizeof(thread_pool_worker));
+  pool->generation = 0;
+  pool->running    = 0;
+  pool->quit       = false;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for(int t = 1; t < threads; ++t){
+    pool->workers[t].pool = pool;
+    pool->workers[t].id   = t;
+    if(pthread_create(&pool->workers[t].thread, NULL, thread_pool_run, &pool->workers[t]) != 0){
+      pool->threads = t;
+      thread_pool_free(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+void thread_pool_free(thread_pool* pool){
+  if(pool == NULL){
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for(int t = 1; t < pool->threads; ++t){
+    pthread_join(pool->workers[t].thread, NULL);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->start);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->workers);
+  free(pool);
+}
+
+int thread_pool_threads(const thread_pool* pool){
+  return pool->threads;
+}
+
+void thread_pool_for(thread_pool* pool, int count, thread_pool_f f, void* context){
+  pthread_mutex_lock(&pool->lock);
+  pool->f          = f;
+  pool->context    = context;
+  pool->count      = count;
+  pool->running    = pool->threads - 1;
+  pool->generation += 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  thread_pool_range(pool, 0);
+  pthread_mutex_lock(&pool->lock);
+  while(pool->running > 0){
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,28 @@
+#ifndef ALGO_GISO_THREAD_POOL_H
+#define ALGO_GISO_THREAD_POOL_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+
+/*
+ * thread_pool
+ *
+ * Threads waiting between calls of thread_pool_for, which splits [0, count) in one contiguous range per thread,
+ * [count t / threads, count (t + 1) / threads) for thread t, the calling thread taking range 0,
+ * and returns once every range is done. f is called on empty ranges too.
+ * Ranges only depend on count and on the number of threads, so that per thread results can be combined
+ * in a fixed order.
+ * A pool is used by one thread at a time
+ */
+
+typedef void (*thread_pool_f)(void* context, int thread, int begin, int end);
+
+typedef struct thread_pool thread_pool;
+
+// NULL if a thread can't be created
+thread_pool* thread_pool_new(int threads);
+void thread_pool_free(thread_pool* pool);
+int thread_pool_threads(const thread_pool* pool);
+void thread_pool_for(thread_pool* pool, int count, thread_pool_f f, void* context);
+
+#endif
@@ -0,0 +1,80 @@
+#include "union_find.h"
+
+#include "string.h"
+
+#include "util.h"
+
+int_union_find int_union_find_empty(){
+  int_union_find u;
+  u.size       = 0;
+  u.bufferSize = 0;
+  u.classes    = 0;
+  u.parent     = NULL;
+  u.class_size = NULL;
+  return u;
+}
+
+int_union_find int_union_find_new(int size){
+  int_union_find u = int_union_find_empty();
+  int_union_find_reset(&u, size);
+  return u;
+}
+
+void int_union_find_free(int_union_find* u){
+  assert(u != NULL);
+  free(u->parent);
+  free(u->class_size);
+  *u = int_union_find_empty();
+}
+
+void int_union_find_reset(int_union_find* u, int size){
+  assert(u != NULL);
+  if(size > u->bufferSize){
+    u->parent     = realloc(u->parent, size * sizeof(int));
+    u->class_size = realloc(u->class_size, size * sizeof(int));
+    u->bufferSize = size;
+  }
+  u->size    = size;
+  u->classes = size;
+  for(int i = 0; i < size; ++i){
+    u->parent[i]     = i;
+    u->class_size[i] = 1;
+  }
+}
+
+void int_union_find_copy_into(int_union_find* u, int_union_find* v){
+  assert(u != NULL && v != NULL);
+  if(v->size > u->bufferSize){
+    u->parent     = realloc(u->parent, v->size * sizeof(int));
+    u->class_size = realloc(u->class_size, v->size * sizeof(int));
+    u->bufferSize = v->size;
+  }
+  u->size    = v->size;
+  u->classes = v->classes;
+  memcpy(u->parent, v->parent, v->size * sizeof(int));
+  memcpy(u->class_size, v->class_size, v->size * sizeof(int));
+}
+
+bool int_union_find_union(int_union_find* u, int a, int b){
+  a = int_union_find_find(u, a);
+  b = int_union_find_find(u, b);
+  if(a == b){
+    return false;
+  }
+  if(u->class_size[a] < u->class_size[b]){
+    SWAP(int, a, b);
+  }
+  u->parent[b]      = a;
+  u->class_size[a] += u->class_size[b];
+  u->classes       -= 1;
+  return true;
+}
+
+int int_union_find_union_pairs(int_union_find* u, const int* pairs, int count){
+  assert(u != NULL && (pairs != NULL || count == 0));
+  int merges = 0;
+  for(int i = 0; i < count; ++i){
+    merges += int_union_find_union(u, pairs[2 * i], pairs[2 * i + 1]);
+  }
+  return merges;
+}
@@ -0,0 +1,52 @@
+#ifndef ALGO_GISO_UNION_FIND_H
+#define ALGO_GISO_UNION_FIND_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "assert.h"
+
+/*
+ * int_union_find
+ *
+ * Partition of [0, size) into classes, used for the orbits of groups of automorphisms.
+ * Union by size and path halving, classes are never split : reset starts again from singletons
+ */
+
+typedef struct int_union_find {
+  int  size;
+  int  bufferSize;
+  int  classes;
+  int* parent;
+  int* class_size; // meaningful for roots only
+} int_union_find;
+
+int_union_find int_union_find_empty();
+int_union_find int_union_find_new(int size);
+void int_union_find_free(int_union_find* u);
+// Singletons of [0, size), keeping the buffers of u
+void int_union_find_reset(int_union_find* u, int size);
+void int_union_find_copy_into(int_union_find* u, int_union_find* v);
+
+static inline int int_union_find_find(int_union_find* u, int a){
+  assert(a >= 0 && a < u->size);
+  while(u->parent[a] != a){
+    u->parent[a] = u->parent[u->parent[a]];
+    a = u->parent[a];
+  }
+  return a;
+}
+
+static inline bool int_union_find_same(int_union_find* u, int a, int b){
+  return int_union_find_find(u, a) == int_union_find_find(u, b);
+}
+
+static inline int int_union_find_class_size(int_union_find* u, int a){
+  return u->class_size[int_union_find_find(u, a)];
+}
+
+// Returns false if a and b were already in the same class
+bool int_union_find_union(int_union_find* u, int a, int b);
+// Merges the classes of pairs[2 i] and pairs[2 i + 1] for i < count, returns the number of merges
+int int_union_find_union_pairs(int_union_find* u, const int* pairs, int count);
+
+#endif
@@ -1,10 +1,34 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "util.h"
 
+#include "time.h"
+
 int int_rotate(int a){
-  return (a >> 16) + (a << 16);
+  return (int) (((unsigned) a >> 16) | ((unsigned) a << 16));
 }
 
 int int_compare(int a, int b){
   return (a < b) ? -1 : (b < a);
 }
 
+double wall_time(){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+uint64_t random_next(uint64_t* state){
+  uint64_t x = (*state += 0x9E3779B97F4A7C15ull);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+int random_int(uint64_t* state, int bound){
+  return (int) (random_next(state) % (uint64_t) bound);
+}
+
+double random_double(uint64_t* state){
+  return (random_next(state) >> 11) * (1. / 9007199254740992.);
+}
@@ -1,6 +1,8 @@
 #ifndef ALGO_GISO_UTIL_H
 #define ALGO_GISO_UTIL_H
 
+#include "stdint.h"
+
 #define SWAP(type, a, b)                          \
   {                                               \
     type tmp = (a);                               \
@@ -14,4 +16,14 @@ int int_rotate(int a);
 
 int int_compare(int a, int b);
 
+// Monotonic wall clock, in seconds
+double wall_time();
+
+// splitmix64, the state belongs to the caller : no global state, threads and runs don't interfere
+uint64_t random_next(uint64_t* state);
+// Uniform in [0, bound), bound > 0
+int random_int(uint64_t* state, int bound);
+// Uniform in [0, 1)
+double random_double(uint64_t* state);
+
 #endif
@@ -0,0 +1,1163 @@
+#include "wl.h"
+
+#include "stdio.h"
+#include "assert.h"
+
+#include "util.h"
+#include "worklist.h"
+#include "wl_parallel.h"
+
+/*
+ * update_neighbours
+ *
+ * Update neighbours in a partition when cell s, of size size, has been split
+ * The first fragment keeps the number of the cell : the hashes of its neighbours don't change,
+ * and in WL_REFINE_HOPCROFT mode its neighbours aren't marked either
+ */
+
+/*
+ * Parallel refinement
+ *
+ * When the partition has a thread pool and no mark is set, the work on a cell of at least WL_PARALLEL_MIN vertices
+ * is split between the threads : hashes and radix sort of its vertices, their placement, and in update_neighbours,
+ * the hash deltas of their neighbours, added atomically, and the marking of the neighbouring cells.
+ * Cells are still refined one at a time in increasing order, sums of deltas don't depend on their order
+ * and the radix sort is stable : partitions are the same as the ones of the serial refinement
+ */
+
+#define WL_PARALLEL_MIN 16384
+
+typedef struct wl_parallel_cell {
+  graph**       g;
+  graph**       rg;
+  wl_partition* p;
+  int           s;
+  int           begin;
+  hash_key*     keys[2];
+  long*         visits; // per thread
+  int*          added;  // per thread, cells added to the update queue
+  int_array*    words;  // per thread, words of the update queue that were empty
+} wl_parallel_cell;
+
+static inline bool wl_parallel_refinement(wl_partition* p, int size){
+  return p->pool != NULL && p->trail_size == 0 && size >= WL_PARALLEL_MIN;
+}
+
+void wl_parallel_mark(wl_parallel_cell* x, int t, int cell){
+  int r = int_worklist_insert_shared(&x->p->update_queue, cell);
+  if(r != 0){
+    x->added[t] += 1;
+    if(r == 2){
+      int_array_append(&x->words[t], cell >> 6);
+    }
+  }
+}
+
+void wl_parallel_update(void* context, int t, int begin, int end){
+  wl_parallel_cell* x = context;
+  wl_partition* p = x->p;
+  for(int j = x->begin + begin; j < x->begin + end; ++j){
+    int v0 = p->perm[0].array[j];
+    TWICE(lane){
+      graph* h = lane == WL_LANE_FORWARD ? x->g[0] : x->rg[0];
+      int* nb = graph_neighbours(h, v0);
+      for(int m = 0; m < graph_degree(h, v0); ++m){
+        wl_parallel_mark(x, t, p->elements[0].array[nb[m]]);
+      }
+      x->visits[t] += graph_degree(h, v0);
+    }
+    int c = p->elements[0].array[v0];
+    if(c == x->s){
+      continue;
+    }
+    uint64_t delta = wl_hash_f(c) - wl_hash_f(x->s);
+    TWICE(k){
+      int v = p->perm[k].array[j];
+      TWICE(lane){
+        graph* h = lane == WL_LANE_FORWARD ? x->g[k] : x->rg[k];
+        uint64_t* hashes = p->elements_hash[k][lane];
+        int* nb = graph_neighbours(h, v);
+        for(int m = 0; m < graph_degree(h, v); ++m){
+          __atomic_fetch_add(&hashes[nb[m]], delta, __ATOMIC_RELAXED);
+        }
+      }
+    }
+  }
+}
+
+void wl_parallel_keys(void* context, int t, int begin, int end){
+  (void) t;
+  wl_parallel_cell* x = context;
+  TWICE(k){
+    for(int j = begin; j < end; ++j){
+      int v = x->p->perm[k].array[x->s + j];
+      x->keys[k][j].hash  = wl_partition_hash(x->p, k, v);
+      x->keys[k][j].value = v;
+    }
+  }
+}
+
+void wl_parallel_place(void* context, int t, int begin, int end){
+  (void) t;
+  wl_parallel_cell* x = context;
+  TWICE(k) wl_partition_place(x->p, k, x->s + begin, end - begin, x->keys[k] + begin);
+}
+
+// Vertices of [begin, s + size), as update_neighbours
+void wl_update_neighbours_parallel(graph* g[2], graph* rg[2], wl_partition* p, int s, int begin, int end){
+  int threads = thread_pool_threads(p->pool);
+  wl_parallel_cell x;
+  x.g      = g;
+  x.rg     = rg;
+  x.p      = p;
+  x.s      = s;
+  x.begin  = begin;
+  x.visits = calloc(threads, sizeof(long));
+  x.added  = calloc(threads, sizeof(int));
+  x.words  = malloc(threads * sizeof(int_array));
+  for(int t = 0; t < threads; ++t){
+    x.words[t] = int_array_empty();
+  }
+  thread_pool_for(p->pool, end - begin, wl_parallel_update, &x);
+  for(int t = 0; t < threads; ++t){
+    p->stats.visits += x.visits[t];
+    p->update_queue.size += x.added[t];
+    for(int i = 0; i < x.words[t].size; ++i){
+      int_worklist_insert_word(&p->update_queue, x.words[t].array[i]);
+    }
+    int_array_free(&x.words[t]);
+  }
+  free(x.visits);
+  free(x.added);
+  free(x.words);
+}
+
+void update_neighbours(graph* g[2], graph* rg[2], wl_partition* p, int s, int size){
+  int begin = p->refine == WL_REFINE_HOPCROFT ? wl_partition_next(p, s) : s;
+  if(wl_parallel_refinement(p, s + size - begin)){
+    wl_update_neighbours_parallel(g, rg, p, s, begin, s + size);
+    return;
+  }
+  for(int j = begin; j < s + size; ++j){
+    int k_[2] = { p->perm[0].array[j],
+                  p->perm[1].array[j] };
+    int* a_[2] = { graph_neighbours(g[0], k_[0]),
+                   graph_neighbours(g[1], k_[1]) };
+    int* ra_[2] = { graph_neighbours(rg[0], k_[0]),
+                    graph_neighbours(rg[1], k_[1]) };
+    int d_[2] = { graph_degree(g[0], k_[0]),
+                  graph_degree(g[1], k_[1]) };
+    int rd_[2] = { graph_degree(rg[0], k_[0]),
+                   graph_degree(rg[1], k_[1]) };
+    p->stats.visits += d_[0] + rd_[0];
+    // Mark neighbouring cells
+    for(int m = 0; m < d_[0]; ++m){
+      int_worklist_insert(&p->update_queue, p->elements[0].array[a_[0][m]]);
+    }
+    for(int m = 0; m < rd_[0]; ++m){
+      int_worklist_insert(&p->update_queue, p->elements[0].array[ra_[0][m]]);
+    }
+    // Update hashes
+    int c = p->elements[0].array[k_[0]];
+    if(c == s){
+      continue;
+    }
+    uint64_t delta = wl_hash_f(c) - wl_hash_f(s);
+    TWICE(l){
+      for(int m = 0; m < d_[l]; ++m){
+        wl_partition_add_hash(p, l, WL_LANE_FORWARD, a_[l][m], delta);
+      }
+      for(int m = 0; m < rd_[l]; ++m){
+        wl_partition_add_hash(p, l, WL_LANE_REVERSE, ra_[l][m], delta);
+      }
+    }
+  }
+}
+
+void hash_key_reverse(hash_key* a, int size){
+  for(int i = 0, j = size - 1; i < j; ++i, --j){
+    SWAP(hash_key, a[i], a[j]);
+  }
+}
+
+// Moves the first largest group of equal hashes of sorted keys to the front, the others keep their order
+void wl_largest_first(hash_key* keys[2], int size){
+  int best = 0, best_size = 0;
+  for(int j = 0; j < size; ){
+    int k = j + 1;
+    while(k < size && keys[0][k].hash == keys[0][j].hash){
+      k += 1;
+    }
+    if(k - j > best_size){
+      best      = j;
+      best_size = k - j;
+    }
+    j = k;
+  }
+  if(best != 0){
+    // Rotation of [0, best + best_size) by three reversals
+    TWICE(k){
+      hash_key_reverse(keys[k], best);
+      hash_key_reverse(keys[k] + best, best_size);
+      hash_key_reverse(keys[k], best + best_size);
+    }
+  }
+}
+
+// Sorted cells of the neighbours of v in h, on side k, written in keys
+void wl_neighbour_cells(graph* h, wl_partition* p, int k, int v, hash_key* keys){
+  int* nb = graph_neighbours(h, v);
+  for(int m = 0; m < graph_degree(h, v); ++m){
+    keys[m].hash  = p->elements[k].array[nb[m]];
+    keys[m].value = 0;
+  }
+  hash_key_sort_buffered(keys, graph_degree(h, v), p->sorted);
+}
+
+bool hash_key_same_hashes(const hash_key* a, const hash_key* b, int size){
+  for(int m = 0; m < size; ++m){
+    if(a[m].hash != b[m].hash){
+      return false;
+    }
+  }
+  return true;
+}
+
+// Same multisets of neighbouring cells for a[0] and a[1] in h[0] and h[1]
+bool wl_same_neighbour_cells(graph* h[2], wl_partition* p, int a[2]){
+  int d = graph_degree(h[0], a[0]);
+  if(d != graph_degree(h[1], a[1])){
+    return false;
+  }
+  TWICE(k) wl_neighbour_cells(h[k], p, k, a[k], p->keys + k * p->size);
+  return hash_key_same_hashes(p->keys, p->keys + p->size, d);
+}
+
+/*
+ * wl_count_collisions
+ *
+ * Vertices of a non singleton cell, on both sides, whose neighbouring cells differ from the ones of the first
+ * vertex of the cell on side 0, in g or in the reverse graph. Those cells could have been split
+ */
+
+int wl_count_collisions(graph* g[2], graph* rg[2], wl_partition* p){
+  int collisions = 0;
+  graph** h[2] = { g, rg };
+  arena_mark m = arena_get_mark(&p->arena);
+  hash_key* first[2] = { arena_alloc(&p->arena, ((size_t) p->size + 1) * sizeof(hash_key)),
+                         arena_alloc(&p->arena, ((size_t) p->size + 1) * sizeof(hash_key)) };
+  hash_key* other = p->keys;
+  for(int s = 0; s < p->size; s = wl_partition_next(p, s)){
+    int size = p->cell_size.array[s];
+    if(size == 1){
+      continue;
+    }
+    int a = p->perm[0].array[s];
+    TWICE(l) wl_neighbour_cells(h[l][0], p, 0, a, first[l]);
+    TWICE(k) for(int j = k == 0 ? 1 : 0; j < size; ++j){
+      int v = p->perm[k].array[s + j];
+      bool same = true;
+      TWICE(l){
+        int d = graph_degree(h[l][0], a);
+        if(same && graph_degree(h[l][k], v) != d){
+          same = false;
+        }else if(same){
+          wl_neighbour_cells(h[l][k], p, k, v, other);
+          same = hash_key_same_hashes(first[l], other, d);
+        }
+      }
+      collisions += !same;
+    }
+  }
+  arena_release(&p->arena, m);
+  return collisions;
+}
+
+/*
+ * stable_partition_exact
+ *
+ * WL_REFINE_EXACT refinement : the queue holds splitters. For a splitter w, count[k][lane][v] is the number
+ * of neighbours of v in w, in g for the forward lane and in the reverse graph for the reverse lane.
+ * The cells holding such vertices are split by those counts, compared on both sides : no hash stands for
+ * a signature. Untouched vertices stay in place, the touched ones are moved to the end of their cell and sorted,
+ * by counting sort when their counts are smaller than their number : O(touched vertices + scanned edges)
+ * per splitter, plus the copy of the cells split below a mark
+ */
+
+// Counts the neighbours in cell w of every vertex, lists the touched vertices and cells
+void wl_count_splitter(graph* g[2], graph* rg[2], wl_partition* p, int w){
+  graph** h[2] = { g, rg };
+  TWICE(k) for(int j = w; j < wl_partition_next(p, w); ++j){
+    int u = p->perm[k].array[j];
+    TWICE(lane){
+      int* nb = graph_neighbours(h[lane][k], u);
+      int d = graph_degree(h[lane][k], u);
+      int* count = p->count[k][lane].array;
+      int* other = p->count[k][1 - lane].array;
+      for(int m = 0; m < d; ++m){
+        int v = nb[m];
+        if(count[v] == 0 && other[v] == 0){
+          int_array_append(&p->touched[k], v);
+          int c = p->elements[k].array[v];
+          if(p->cell_touched[0].array[c] == 0 && p->cell_touched[1].array[c] == 0){
+            int_array_append(&p->touched_cells, c);
+          }
+          p->cell_touched[k].array[c] += 1;
+        }
+        count[v] += 1;
+      }
+      if(k == 0){
+        p->stats.visits += d;
+      }
+    }
+  }
+}
+
+// Back to zero counts
+void wl_clear_splitter(wl_partition* p){
+  TWICE(k){
+    for(int i = 0; i < p->touched[k].size; ++i){
+      int v = p->touched[k].array[i];
+      TWICE(lane) p->count[k][lane].array[v] = 0;
+      p->cell_touched[k].array[p->elements[k].array[v]] = 0;
+    }
+    p->touched[k].size = 0;
+  }
+  p->touched_cells.size = 0;
+  p->touched_count.size = 0;
+}
+
+// Moves the touched vertices to the end of their cells, false if some cell has more of them on one side
+bool wl_gather_touched(wl_partition* p){
+  for(int i = 0; i < p->touched_cells.size; ++i){
+    int c = p->touched_cells.array[i];
+    if(p->cell_touched[0].array[c] != p->cell_touched[1].array[c]){
+      return false;
+    }
+    int_array_append(&p->touched_count, p->cell_touched[0].array[c]);
+    wl_partition_save(p, c);
+  }
+  // cell_touched counts down the free places at the end of each cell
+  TWICE(k) for(int i = 0; i < p->touched[k].size; ++i){
+    int v = p->touched[k].array[i];
+    int c = p->elements[k].array[v];
+    int target = wl_partition_next(p, c) - p->cell_touched[k].array[c];
+    p->cell_touched[k].array[c] -= 1;
+    int q = p->position[k].array[v];
+    int b = p->perm[k].array[target];
+    p->perm[k].array[q]      = b;
+    p->position[k].array[b]  = q;
+    p->perm[k].array[target] = v;
+    p->position[k].array[v]  = target;
+  }
+  return true;
+}
+
+// Splits cell s, its last touched vertices being touched, false if their counts differ on both sides
+bool wl_split_exact(wl_partition* p, int s, int touched){
+  int size = p->cell_size.array[s];
+  int from = s + size - touched;
+  hash_key* keys[2] = { p->keys, p->keys + p->size };
+  int max = 0;
+  bool uniform = true;
+  TWICE(k) for(int j = 0; j < touched; ++j){
+    int v = p->perm[k].array[from + j];
+    int f = p->count[k][WL_LANE_FORWARD].array[v];
+    int r = p->count[k][WL_LANE_REVERSE].array[v];
+    keys[k][j].hash  = (uint64_t) f << 32 | (uint32_t) r;
+    keys[k][j].value = v;
+    max = f > max ? f : max;
+    max = r > max ? r : max;
+    uniform = uniform && keys[k][j].hash == keys[0][0].hash;
+  }
+  if(uniform && from == s){
+    return true;
+  }
+  TWICE(k){
+    if(touched > 16 && max < touched){
+      p->bound.size = max + 1;
+      hash_key_sort_bounded(keys[k], touched, p->sorted, &p->bound);
+    }else{
+      hash_key_sort_buffered(keys[k], touched, p->sorted);
+    }
+  }
+  for(int j = 0; j < touched; ++j){
+    if(keys[0][j].hash != keys[1][j].hash){
+      return false;
+    }
+  }
+  bool queued = int_worklist_contains(&p->update_queue, s);
+  TWICE(k) wl_partition_place(p, k, from, touched, keys[k]);
+  wl_partition_split(p, s, from, keys[0]);
+  p->stats.splits += 1;
+  // All the fragments if s was still to be used, the first one keeping its place, otherwise all but the largest one
+  int largest = s;
+  for(int t = s; t < s + size; t = wl_partition_next(p, t)){
+    if(p->cell_size.array[t] > p->cell_size.array[largest]){
+      largest = t;
+    }
+  }
+  for(int t = s; t < s + size; t = wl_partition_next(p, t)){
+    if(queued || t != largest){
+      int_worklist_insert(&p->update_queue, t);
+    }
+  }
+  return true;
+}
+
+bool stable_partition_exact(graph* g[2], graph* rg[2], wl_partition* p){
+  while(!int_worklist_is_empty(&p->update_queue)){
+    int w = int_worklist_pop(&p->update_queue);
+    p->stats.refinements += 1;
+    wl_count_splitter(g, rg, p, w);
+    bool valid = wl_gather_touched(p);
+    for(int i = 0; i < p->touched_cells.size && valid; ++i){
+      valid = wl_split_exact(p, p->touched_cells.array[i], p->touched_count.array[i]);
+    }
+    wl_clear_splitter(p);
+    if(!valid){
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * stable_partition
+ *
+ * Finds the maximum refinement of a partition of g
+ * Returns false if p is an invalid partition, and true otherwise
+ * Updates p with the new partition
+ *
+ * For a given vertex, we compute its signature in the graph g : the multiset of the partition classes of its neighbours
+ * A hash of the multiset is actually computed instead of the multiset to avoid array sorting
+ *
+ * We inspect all classes of the given partition, spliting some classes into new classes until the partition can't be refined.
+ * For each class, we split the class if it is possible
+ * When a class is split, we remember we have to check its neighbour classes
+ *
+ * Cells are split in place, the loop doesn't allocate
+ */
+
+bool stable_partition(graph* g[2], graph* rg[2], wl_partition* p){
+  TWICE(i) assert(g[i] != NULL);
+  TWICE(i) assert(rg[i] != NULL);
+  assert(p != NULL);
+  assert(g[0]->size == g[1]->size);
+  assert(rg[0]->size == rg[1]->size);
+  assert(g[0]->size == rg[0]->size);
+  assert(g[0]->size == p->size);
+
+  if(p->refine == WL_REFINE_EXACT){
+    return stable_partition_exact(g, rg, p);
+  }
+  while(!int_worklist_is_empty(&p->update_queue)){
+    int s = int_worklist_pop(&p->update_queue);
+    int size = p->cell_size.array[s];
+    p->stats.refinements += 1;
+
+    if(size == 1){
+      // No refinement possible, still check if the partition is valid !
+      int a[2];
+      TWICE(j) a[j] = p->perm[j].array[s];
+      if(wl_partition_hash(p, 0, a[0]) != wl_partition_hash(p, 1, a[1])){
+        return false;
+      }
+      if(!wl_same_neighbour_cells(g, p, a)
+         || !wl_same_neighbour_cells(rg, p, a)){
+        p->stats.collisions += 1;
+        return false;
+      }
+      // Partition is valid from this node
+    }else{
+      // If a refinement is possible
+      // Lanes are compared before being combined
+      int a = p->perm[0].array[s];
+      uint64_t first[2] = { p->elements_hash[0][WL_LANE_FORWARD][a], p->elements_hash[0][WL_LANE_REVERSE][a] };
+      bool uniform = true;
+      TWICE(k){
+        uint64_t* forward = p->elements_hash[k][WL_LANE_FORWARD];
+        uint64_t* reverse = p->elements_hash[k][WL_LANE_REVERSE];
+        for(int j = s; j < s + size && uniform; ++j){
+          int v = p->perm[k].array[j];
+          uniform = forward[v] == first[0] && reverse[v] == first[1];
+        }
+      }
+      if(!uniform){
+        // if the partition is valid, sorting the hashes of the cell in the two graphs should give the same result
+        wl_partition_save(p, s);
+        hash_key* keys[2] = { p->keys, p->keys + p->size };
+        bool parallel = wl_parallel_refinement(p, size);
+        wl_parallel_cell x;
+        x.p = p;
+        x.s = s;
+        TWICE(k) x.keys[k] = keys[k];
+        if(parallel){
+          thread_pool_for(p->pool, size, wl_parallel_keys, &x);
+          TWICE(k) hash_key_radix_sort_pool(keys[k], size, p->sorted, p->pool);
+        }else{
+          TWICE(k){
+            for(int j = 0; j < size; ++j){
+              int v = p->perm[k].array[s + j];
+              keys[k][j].hash  = wl_partition_hash(p, k, v);
+              keys[k][j].value = v;
+            }
+            hash_key_sort_buffered(keys[k], size, p->sorted);
+          }
+        }
+        for(int j = 0; j < size; ++j){
+          if(keys[0][j].hash != keys[1][j].hash){
+            return false;
+          }
+        }
+        wl_largest_first(keys, size);
+        if(parallel){
+          thread_pool_for(p->pool, size, wl_parallel_place, &x);
+        }else{
+          TWICE(k) wl_partition_place(p, k, s, size, keys[k]);
+        }
+        wl_partition_split(p, s, s, keys[0]);
+        p->stats.splits += 1;
+        update_neighbours(g, rg, p, s, size);
+      }
+    }
+  }
+  if(p->check){
+    p->stats.collisions += wl_count_collisions(g, rg, p);
+  }
+  return true;
+}
+
+/*
+ * wl_individualize
+ *
+ * The new cell is the last position of cell s : cell numbers only depend on the choices made, not on vertex labels
+ */
+
+void wl_individualize(graph* g[2], graph* rg[2], wl_partition* p, int s, int a[2]){
+  assert(p != NULL);
+  assert(s >= 0 && s < p->size);
+  TWICE(k) assert(p->elements[k].array[a[k]] == s);
+
+  int size = p->cell_size.array[s];
+  int t = wl_partition_individualize(p, s, a);
+  if(p->refine == WL_REFINE_EXACT){
+    // The other vertices of s are split by the new cell alone
+    int_worklist_insert(&p->update_queue, t);
+    return;
+  }
+
+  // For all neighbours of the old cell, only the neighbours of the new one in WL_REFINE_HOPCROFT mode
+  int begin = p->refine == WL_REFINE_HOPCROFT ? t : s;
+  for(int j = begin; j < s + size; ++j){
+    TWICE(l){
+      int v = p->perm[l].array[j];
+      int* nb = graph_neighbours(g[l], v);
+      for(int m = 0; m < graph_degree(g[l], v); ++m){
+        int_worklist_insert(&p->update_queue, p->elements[l].array[nb[m]]);
+      }
+      int* rnb = graph_neighbours(rg[l], v);
+      for(int m = 0; m < graph_degree(rg[l], v); ++m){
+        int_worklist_insert(&p->update_queue, p->elements[l].array[rnb[m]]);
+      }
+      p->stats.visits += graph_degree(g[l], v) + graph_degree(rg[l], v);
+    }
+  }
+  if(p->refine != WL_REFINE_HOPCROFT){
+    int_worklist_insert(&p->update_queue, s);
+  }
+  int_worklist_insert(&p->update_queue, t);
+  // For all neighbours of the new cell
+  uint64_t delta = wl_hash_f(t) - wl_hash_f(s);
+  TWICE(j){
+    for(int m = 0; m < graph_degree(g[j], a[j]); ++m){
+      wl_partition_add_hash(p, j, WL_LANE_FORWARD, graph_neighbours(g[j], a[j])[m], delta);
+    }
+    for(int m = 0; m < graph_degree(rg[j], a[j]); ++m){
+      wl_partition_add_hash(p, j, WL_LANE_REVERSE, graph_neighbours(rg[j], a[j])[m], delta);
+    }
+  }
+}
+
+int wl_target_from_name(const char* name){
+  const char* names[] = WL_TARGET_NAMES;
+  for(int i = 0; i < WL_TARGET_COUNT; ++i){
+    if(strcmp(name, names[i]) == 0){
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Non singleton cells non trivially joined to cell s, count being zero
+int wl_joins(graph* g[2], graph* rg[2], wl_partition* p, int s, int* count){
+  int v = p->perm[0].array[s];
+  graph* h[2] = { g[0], rg[0] };
+  int joins = 0;
+  TWICE(l){
+    int* nb = graph_neighbours(h[l], v);
+    int d = graph_degree(h[l], v);
+    for(int m = 0; m < d; ++m){
+      count[p->elements[0].array[nb[m]]] += 1;
+    }
+    for(int m = 0; m < d; ++m){
+      int c = p->elements[0].array[nb[m]];
+      if(count[c] > 0){
+        joins += p->cell_size.array[c] > 1 && count[c] < p->cell_size.array[c];
+        count[c] = 0;
+      }
+    }
+  }
+  return joins;
+}
+
+int wl_target_cell(graph* g[2], graph* rg[2], wl_partition* p, int strategy, int_array* count){
+  return wl_target_cell_from(g, rg, p, strategy, count, 0);
+}
+
+int wl_target_cell_from(graph* g[2], graph* rg[2], wl_partition* p, int strategy, int_array* count, int from){
+  assert(p != NULL);
+  assert(from >= 0 && from <= p->size);
+  int best = p->size;
+  int best_value = 0;
+  for(int s = from; s < p->size; s = wl_partition_next(p, s)){
+    int size = p->cell_size.array[s];
+    if(size == 1){
+      continue;
+    }
+    if(strategy == WL_TARGET_FIRST){
+      return s;
+    }
+    int value;
+    if(strategy == WL_TARGET_SMALLEST){
+      value = -size;
+    }else if(strategy == WL_TARGET_JOINS){
+      if(count->size < p->size){
+        int_array_reserve(count, p->size);
+        memset(count->array, 0, p->size * sizeof(int));
+        count->size = p->size;
+      }
+      value = wl_joins(g, rg, p, s, count->array);
+    }else{
+      value = size;
+    }
+    if(best == p->size || value > best_value || (value == best_value && strategy == WL_TARGET_LARGEST)){
+      best       = s;
+      best_value = value;
+    }
+  }
+  return best;
+}
+
+/*
+ * graph_isomorphism_WL
+ * Weisfeiler-Lehman algorithm
+ */
+
+wl_orbits wl_orbits_empty(){
+  wl_orbits o;
+  o.automorphisms = int_array_array_empty();
+  o.path          = int_array_empty();
+  o.orbits        = NULL;
+  o.active        = int_array_empty();
+  o.capacity      = 0;
+  o.mark          = int_array_empty();
+  o.stamp         = 0;
+  return o;
+}
+
+void wl_orbits_free(wl_orbits* o){
+  assert(o != NULL);
+  int_array_array_free(&o->automorphisms);
+  int_array_free(&o->path);
+  for(int d = 0; d < o->capacity; ++d){
+    int_union_find_free(&o->orbits[d]);
+  }
+  free(o->orbits);
+  int_array_free(&o->active);
+  int_array_free(&o->mark);
+  *o = wl_orbits_empty();
+}
+
+void wl_orbits_reset(wl_orbits* o, int size){
+  assert(o != NULL);
+  for(int i = 0; i < o->automorphisms.size; ++i){
+    int_array_free(&o->automorphisms.array[i]);
+  }
+  o->automorphisms.size = 0;
+  // A path has at most size vertices, a leaf is at depth size at most
+  if(size + 1 > o->capacity){
+    o->orbits = realloc(o->orbits, (size + 1) * sizeof(int_union_find));
+    for(int d = o->capacity; d < size + 1; ++d){
+      o->orbits[d] = int_union_find_empty();
+    }
+    o->capacity = size + 1;
+  }
+  int_array_reserve(&o->path, size + 1);
+  o->path.size = size + 1;
+  int_array_reserve(&o->active, size + 1);
+  o->active.size = size + 1;
+  memset(o->active.array, 0, (size + 1) * sizeof(int));
+  int_array_reserve(&o->mark, size);
+  o->mark.size = size;
+  memset(o->mark.array, 0, size * sizeof(int));
+  o->stamp = 0;
+}
+
+void wl_orbits_set_path(wl_orbits* o, int depth, int v){
+  assert(depth < o->path.size);
+  o->path.array[depth] = v;
+}
+
+void wl_orbits_enter(wl_orbits* o, int depth){
+  assert(depth < o->capacity);
+  int size = o->path.size - 1;
+  int_union_find_reset(&o->orbits[depth], size);
+  // Vertices of the path are marked with a new stamp
+  o->stamp += 1;
+  for(int d = 0; d < depth; ++d){
+    o->mark.array[o->path.array[d]] = o->stamp;
+  }
+  for(int i = 0; i < o->automorphisms.size; ++i){
+    int_array* gamma = &o->automorphisms.array[i];
+    bool fixed = true;
+    for(int k = 0; k < gamma->size && fixed; k += 2){
+      fixed = o->mark.array[gamma->array[k]] != o->stamp;
+    }
+    if(fixed){
+      int_union_find_union_pairs(&o->orbits[depth], gamma->array, gamma->size / 2);
+    }
+  }
+  o->active.array[depth] = 1;
+}
+
+void wl_orbits_inherit(wl_orbits* o, int depth){
+  assert(depth + 1 < o->capacity && !o->active.array[depth + 1]);
+  SWAP(int_union_find, o->orbits[depth], o->orbits[depth + 1]);
+  o->active.array[depth] = 1;
+}
+
+void wl_orbits_leave(wl_orbits* o, int depth){
+  o->active.array[depth] = 0;
+}
+
+bool wl_orbits_explored(wl_orbits* o, int depth, int v, const int* explored, int count){
+  assert(o->active.array[depth]);
+  int_union_find* u = &o->orbits[depth];
+  int r = int_union_find_find(u, v);
+  for(int k = 0; k < count; ++k){
+    if(int_union_find_find(u, explored[k]) == r){
+      return true;
+    }
+  }
+  return false;
+}
+
+bool wl_orbits_add_moved(wl_orbits* o, int depth, int_array* moved){
+  // The first vertex of the path moved gives the nodes whose paths are fixed
+  o->stamp += 1;
+  for(int k = 0; k < moved->size; k += 2){
+    o->mark.array[moved->array[k]] = o->stamp;
+  }
+  int fixed = 0;
+  while(fixed < depth && o->mark.array[o->path.array[fixed]] != o->stamp){
+    fixed += 1;
+  }
+  // Deepest node whose path gamma fixes, it moves the vertex individualized there : merges happen at least there
+  if(fixed < depth && !o->active.array[fixed]){
+    wl_orbits_enter(o, fixed);
+  }
+  int merges = 0;
+  for(int d = 0; d <= fixed; ++d){
+    if(o->active.array[d]){
+      merges += int_union_find_union_pairs(&o->orbits[d], moved->array, moved->size / 2);
+    }
+  }
+  // Nodes entered later only use the automorphisms which merged orbits, the others are generated by them
+  // or were useless on the path where they were found
+  if(merges == 0){
+    return false;
+  }
+  int_array_array_append(&o->automorphisms, int_array_copy(moved));
+  return true;
+}
+
+bool wl_orbits_add(wl_orbits* o, int depth, int_array* gamma){
+  int_array moved = int_array_empty();
+  for(int v = 0; v < gamma->size; ++v){
+    if(gamma->array[v] != v){
+      int_array_append(&moved, v);
+      int_array_append(&moved, gamma->array[v]);
+    }
+  }
+  bool added = wl_orbits_add_moved(o, depth, &moved);
+  int_array_free(&moved);
+  return added;
+}
+
+ARRAY_DEFINE(wl_frame_array, wl_frame)
+
+wl_workspace wl_workspace_new(){
+  wl_workspace ws;
+  TWICE(i) ws.rg[i] = graph_empty();
+  ws.p      = wl_partition_empty();
+  ws.target = WL_TARGET_FIRST;
+  ws.count  = int_array_empty();
+  ws.stats.nodes = ws.stats.failures = ws.stats.automorphisms = ws.stats.pruned = 0;
+  ws.stats.depth = 0;
+  ws.orbits = wl_orbits_empty();
+  ws.q      = wl_partition_empty();
+  ws.path   = int_array_empty();
+  ws.frames   = wl_frame_array_empty();
+  ws.q_frames = wl_frame_array_empty();
+  ws.report   = 0;
+  ws.budget   = 0;
+  return ws;
+}
+
+void wl_workspace_free(wl_workspace* ws){
+  assert(ws != NULL);
+  TWICE(i) graph_free(&ws->rg[i]);
+  wl_partition_free(&ws->p);
+  int_array_free(&ws->count);
+  wl_orbits_free(&ws->orbits);
+  wl_partition_free(&ws->q);
+  int_array_free(&ws->path);
+  free(ws->frames.array);
+  free(ws->q_frames.array);
+}
+
+double wl_workspace_progress(const wl_workspace* ws){
+  double progress = 0., weight = 1.;
+  for(int k = 0; k < ws->frames.size; ++k){
+    const wl_frame* f = &ws->frames.array[k];
+    if(f->j > 0){
+      progress += weight * f->j / f->end;
+    }
+    weight /= f->end;
+  }
+  return progress;
+}
+
+void wl_workspace_reverse(wl_workspace* ws, graph* g[2], graph* rg_[2], graph* rg[2]){
+  TWICE(i){
+    if(rg_ != NULL && rg_[i] != NULL && !graph_is_empty(rg_[i])){
+      rg[i] = rg_[i];
+    }else if(i == 1 && g[1] == g[0] && rg[0] == &ws->rg[0]){
+      // Same graph on both sides
+      rg[1] = rg[0];
+    }else{
+      graph_reverse_into(g[i], &ws->rg[i]);
+      rg[i] = &ws->rg[i];
+    }
+  }
+}
+
+void wl_search_init(wl_search* s, wl_workspace* ws, graph* g[2], graph* rg_[2]){
+  s->ws = ws;
+  TWICE(i) s->g[i] = g[i];
+  wl_workspace_reverse(ws, g, rg_, s->rg);
+  TWICE(i){
+    s->h[i]  = g[1];
+    s->rh[i] = s->rg[1];
+  }
+  s->budget   = 0;
+  s->parallel = NULL;
+  s->worker   = 0;
+  s->cancel   = NULL;
+  s->candidates  = NULL;
+  s->ncandidates = 0;
+  s->start       = 0;
+  wl_orbits_reset(&ws->orbits, g[1]->size);
+  int_array_reserve(&ws->path, 2 * (g[1]->size + 1));
+  ws->path.size = 2 * (g[1]->size + 1);
+}
+
+// Leaf below the current node of q, in at most budget nodes
+bool wl_automorphism_backtrack(wl_search* s, wl_partition* q){
+  wl_frame_array* frames = &s->ws->q_frames;
+  int base = frames->size;
+  bool found = false;
+  while(true){
+    int c = -1;
+    if(s->budget > 0 && !wl_search_cancelled(s)){
+      s->budget -= 1;
+      if(stable_partition(s->h, s->rh, q)){
+        c = wl_target_cell(s->h, s->rh, q, s->ws->target, &s->ws->count);
+      }
+    }
+    if(c == q->size){
+      found = true;
+      break;
+    }
+    if(c >= 0){
+      wl_frame* f = wl_frame_array_push(frames);
+      f->c    = c;
+      f->size = q->cell_size.array[c];
+      f->j    = -1;
+    }
+    // Next candidate of the deepest node with one left, the failed child being undone
+    while(frames->size > base){
+      wl_frame* f = &frames->array[frames->size - 1];
+      if(f->j >= 0){
+        wl_partition_undo(q);
+      }
+      f->j += 1;
+      if(f->j < f->size && s->budget > 0){
+        int a[2] = { q->perm[0].array[f->c + f->size - 1],
+                     q->perm[1].array[f->c + f->j] };
+        wl_partition_mark(q);
+        wl_individualize(s->h, s->rh, q, f->c, a);
+        break;
+      }
+      frames->size -= 1;
+    }
+    if(frames->size == base){
+      break;
+    }
+  }
+  // A leaf keeps the marks of its path
+  frames->size = base;
+  return found;
+}
+
+// Automorphism of g[1] fixing the path to the node at depth and mapping a to b, added to the orbits if found
+bool wl_find_automorphism(wl_search* s, int depth, int a, int b, long budget){
+  wl_workspace* ws = s->ws;
+  wl_orbits* o = &ws->orbits;
+  wl_partition* q = &ws->q;
+  q->refine = ws->p.refine;
+  bool valid = wl_graph_degree_partition_into(s->h, q) && stable_partition(s->h, s->rh, q);
+  assert(valid);
+  // Same cells as the second side of the search
+  for(int d = 0; d < depth && valid; ++d){
+    int v = o->path.array[d];
+    int c = q->elements[0].array[v];
+    if(q->cell_size.array[c] > 1){
+      int x[2] = { v, v };
+      wl_individualize(s->h, s->rh, q, c, x);
+      valid = stable_partition(s->h, s->rh, q);
+    }
+  }
+  bool found = false;
+  int c = q->elements[0].array[a];
+  if(valid && q->elements[0].array[b] == c && q->cell_size.array[c] > 1){
+    int x[2] = { a, b };
+    wl_individualize(s->h, s->rh, q, c, x);
+    s->budget = budget;
+    found = wl_automorphism_backtrack(s, q);
+  }
+  wl_partition_trail_clear(q);
+  if(!found){
+    return false;
+  }
+  // Pairs moved, taken from the arena of the node : the orbits keep their own copy
+  arena_mark m = arena_get_mark(&ws->p.arena);
+  int_array moved = int_array_arena(&ws->p.arena, 2 * q->size);
+  moved.size = 0;
+  for(int j = 0; j < q->size; ++j){
+    int v = q->perm[0].array[j];
+    int w = q->perm[1].array[j];
+    if(v != w){
+      moved.array[moved.size++] = v;
+      moved.array[moved.size++] = w;
+    }
+  }
+  if(wl_orbits_add_moved(o, depth, &moved)){
+    ws->stats.automorphisms += 1;
+  }
+  arena_release(&ws->p.arena, m);
+  return true;
+}
+
+/*
+ * Gives the upper half of the candidates (j, end) of the node at depth, whose target cell is c, to other workers,
+ * but those in the orbit of a previous one. Returns the end of the candidates kept
+ */
+int wl_backtrack_share(wl_search* s, int depth, int c, const int* candidates, int j, int end){
+  wl_partition* p = &s->ws->p;
+  wl_orbits* o = &s->ws->orbits;
+  int mid = j + 1 + (end - j - 1) / 2;
+  arena_mark m = arena_get_mark(&p->arena);
+  int_array shared = int_array_arena(&p->arena, end - mid);
+  shared.size = 0;
+  for(int k = mid; k < end; ++k){
+    if(o->active.array[depth] && wl_orbits_explored(o, depth, candidates[k], candidates, k)){
+      s->ws->stats.pruned += 1;
+    }else{
+      shared.array[shared.size++] = candidates[k];
+    }
+  }
+  if(shared.size != 0){
+    s->ws->path.array[2 * depth] = p->perm[0].array[c + p->cell_size.array[c] - 1];
+    wl_parallel_push(s->parallel, s->worker, s->ws->path.array, depth, shared.array, shared.size);
+  }
+  arena_release(&p->arena, m);
+  return mid;
+}
+
+// Visits the node at depth : its target cell, p->size at a leaf, -1 if the node fails
+int wl_backtrack_enter(wl_search* s, int depth){
+  wl_workspace* ws = s->ws;
+  wl_partition* p = &ws->p;
+  if(wl_search_cancelled(s)){
+    return -1;
+  }
+  ws->stats.nodes += 1;
+  if(depth > ws->stats.depth){
+    ws->stats.depth = depth;
+  }
+  if(ws->report > 0 && ws->stats.nodes % ws->report == 0){
+    fprintf(stderr, "progress : %ld nodes, depth %d, %.6f of the tree searched\n",
+            ws->stats.nodes, ws->frames.size, wl_workspace_progress(ws));
+  }
+  if(!stable_partition(s->g, s->rg, p)){
+    ws->stats.failures += 1;
+    return -1;
+  }
+  return wl_target_cell(s->g, s->rg, p, ws->target, &ws->count);
+}
+
+void wl_backtrack_push(wl_search* s, int depth, int c){
+  wl_partition* p = &s->ws->p;
+  wl_frame* f = wl_frame_array_push(&s->ws->frames);
+  f->depth      = depth;
+  f->c          = c;
+  f->size       = p->cell_size.array[c];
+  f->candidates = p->perm[1].array + c;
+  f->end        = f->size;
+  if(s->candidates != NULL && depth == s->start){
+    f->candidates = s->candidates;
+    f->end        = s->ncandidates;
+  }
+  f->j      = -1;
+  f->failed = -1;
+  f->used   = 0;
+}
+
+/*
+ * Individualizes the next candidate of frame f which is not pruned : false if there is none left.
+ * Each choice is rewound with the trail instead of working on a copy, and what it allocated in the arena
+ * is released with it
+ */
+bool wl_backtrack_next(wl_search* s, wl_frame* f){
+  wl_workspace* ws = s->ws;
+  wl_partition* p = &ws->p;
+  wl_orbits* o = &ws->orbits;
+  int depth = f->depth;
+  while(f->j + 1 < f->end && !wl_search_cancelled(s)){
+    f->j += 1;
+    int b = f->candidates[f->j];
+    if(f->failed >= 0){
+      if(!o->active.array[depth]){
+        wl_orbits_enter(o, depth);
+      }
+      if(wl_orbits_explored(o, depth, b, f->candidates, f->j)
+         || (wl_find_automorphism(s, depth, f->failed, b, f->used)
+             && wl_orbits_explored(o, depth, b, f->candidates, f->j))){
+        ws->stats.pruned += 1;
+        continue;
+      }
+    }
+    if(s->parallel != NULL && f->j + 1 < f->end && wl_parallel_hungry(s->parallel)){
+      f->end = wl_backtrack_share(s, depth, f->c, f->candidates, f->j, f->end);
+    }
+    int a[2] = { p->perm[0].array[f->c + f->size - 1], b };
+    f->nodes = ws->stats.nodes;
+    wl_orbits_set_path(o, depth, b);
+    ws->path.array[2 * depth]     = a[0];
+    ws->path.array[2 * depth + 1] = a[1];
+    f->mark = arena_get_mark(&p->arena);
+    wl_partition_mark(p);
+    wl_individualize(s->g, s->rg, p, f->c, a);
+    return true;
+  }
+  return false;
+}
+
+// Candidate j of frame f failed
+void wl_backtrack_failed(wl_search* s, wl_frame* f){
+  wl_partition* p = &s->ws->p;
+  wl_partition_undo(p);
+  arena_release(&p->arena, f->mark);
+  f->failed = f->candidates[f->j];
+  f->used   = s->ws->stats.nodes - f->nodes;
+}
+
+bool wl_backtrack(wl_search* s, int depth){
+  wl_workspace* ws = s->ws;
+  wl_frame_array* frames = &ws->frames;
+  int base = frames->size;
+  bool found = false;
+  while(true){
+    int c = wl_backtrack_enter(s, depth);
+    // 1 element / cell : isomorphism
+    if(c == ws->p.size){
+      found = true;
+      break;
+    }
+    if(c >= 0){
+      wl_backtrack_push(s, depth, c);
+    }else if(frames->size > base){
+      wl_backtrack_failed(s, &frames->array[frames->size - 1]);
+    }
+    // Deepest node with a candidate left
+    while(frames->size > base && !wl_backtrack_next(s, &frames->array[frames->size - 1])){
+      wl_orbits_leave(&ws->orbits, frames->array[frames->size - 1].depth);
+      frames->size -= 1;
+      if(frames->size > base){
+        wl_backtrack_failed(s, &frames->array[frames->size - 1]);
+      }
+    }
+    if(frames->size == base){
+      break;
+    }
+    depth = frames->array[frames->size - 1].depth + 1;
+  }
+  // The nodes of the path to the leaf keep their marks
+  while(frames->size > base){
+    wl_orbits_leave(&ws->orbits, frames->array[frames->size - 1].depth);
+    frames->size -= 1;
+  }
+  return found;
+}
+
+/*
+ * rg are the reverse graphs of g
+ * rg may be NULL, or some of its graphs may be empty : they are then computed in the workspace
+ */
+int_array graph_isomorphism_WL_workspace(wl_workspace* ws, graph* g[2], graph* rg_[2]){
+  TWICE(i) assert(g[i] != NULL);
+  assert(ws != NULL);
+  if(g[0]->size != g[1]->size){
+    return int_array_empty();
+  }
+  wl_search s;
+  wl_search_init(&s, ws, g, rg_);
+
+  wl_partition* p = &ws->p;
+  bool found = wl_graph_degree_partition_into(g, p) && wl_backtrack(&s, 0);
+  wl_partition_trail_clear(p);
+  if(found){
+    int_array iso = int_array_new(g[0]->size);
+    for(int j = 0; j < p->size; ++j){
+      iso.array[p->perm[0].array[j]] = p->perm[1].array[j];
+    }
+    return iso;
+  }else{
+    return int_array_empty();
+  }
+}
+
+// rg are the reverse graphs of g
+int_array graph_isomorphism_WL_reverse(graph* g[2], graph* rg[2]){
+  wl_workspace ws = wl_workspace_new();
+  int_array iso = graph_isomorphism_WL_workspace(&ws, g, rg);
+  wl_workspace_free(&ws);
+  return iso;
+}
+
+int_array graph_isomorphism_WL(graph* g[2]){
+  return graph_isomorphism_WL_reverse(g, NULL);
+}
+
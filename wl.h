@@ -0,0 +1,201 @@
+#ifndef ALGO_GISO_WL_H
+#define ALGO_GISO_WL_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "array.h"
+#include "graph.h"
+#include "wl_partition.h"
+#include "union_find.h"
+
+/*
+ * Weisfeiler-Lehman refinement of a pair of graphs
+ * g are the graphs, rg their reverse graphs
+ */
+
+void update_neighbours(graph* g[2], graph* rg[2], wl_partition* p, int s, int size);
+bool stable_partition(graph* g[2], graph* rg[2], wl_partition* p);
+// Moves a[0] and a[1] from cell s to a new cell, and marks the cells to update
+void wl_individualize(graph* g[2], graph* rg[2], wl_partition* p, int s, int a[2]);
+
+/*
+ * Target cell strategies : the non singleton cell whose vertices are individualized at a search node
+ * WL_TARGET_FIRST         : the first one
+ * WL_TARGET_SMALLEST      : the first smallest one
+ * WL_TARGET_LARGEST       : the last largest one
+ * WL_TARGET_JOINS         : the first one non trivially joined to the most non singleton cells,
+ *                           a vertex of the cell having some but not all of the vertices of the other cell
+ *                           as neighbours, in the graph or in its reverse graph
+ * WL_TARGET_FIRST_LARGEST : the first largest one
+ * Cells are ordered by position, choices only depend on the partition, not on vertex labels
+ */
+
+#define WL_TARGET_FIRST         0
+#define WL_TARGET_SMALLEST      1
+#define WL_TARGET_LARGEST       2
+#define WL_TARGET_JOINS         3
+#define WL_TARGET_FIRST_LARGEST 4
+#define WL_TARGET_COUNT         5
+#define WL_TARGET_NAMES { "first", "smallest", "largest", "joins", "first-largest" }
+
+// -1 if there is no such strategy
+int wl_target_from_name(const char* name);
+
+// First position of the target cell of p, on side 0, p->size if p is discrete
+// count is a buffer of p->size integers
+int wl_target_cell(graph* g[2], graph* rg[2], wl_partition* p, int strategy, int_array* count);
+// Same as wl_target_cell when the cells before position from are singletons, as below a node whose target cell
+// was from with WL_TARGET_FIRST : the scan starts there
+int wl_target_cell_from(graph* g[2], graph* rg[2], wl_partition* p, int strategy, int_array* count, int from);
+
+typedef struct wl_search_stats {
+  long nodes;         // stable partitions computed
+  long failures;      // partitions found invalid
+  int  depth;         // maximum depth
+  long automorphisms; // automorphisms found
+  long pruned;        // candidates skipped because of an automorphism
+} wl_search_stats;
+
+/*
+ * wl_orbits
+ *
+ * Automorphisms found by a search, and for each node of the current path, the orbits of those that fix
+ * the vertices individualized above it. A candidate in the orbit of an explored one leads to the same result
+ * and is skipped. Orbits of a node are only computed once it needs them
+ */
+
+typedef struct wl_orbits {
+  int_array_array automorphisms; // pairs v, gamma(v) of the vertices moved
+  int_array       path;   // path.array[d] : vertex individualized at depth d
+  int_union_find* orbits; // orbits[d] : node at depth d
+  int_array       active; // active.array[d] : orbits[d] is up to date
+  int             capacity;
+  int_array       mark;   // vertices marked with the current stamp
+  int             stamp;
+} wl_orbits;
+
+wl_orbits wl_orbits_empty();
+void wl_orbits_free(wl_orbits* o);
+// New search on size vertices, automorphisms are forgotten
+void wl_orbits_reset(wl_orbits* o, int size);
+// Sets the vertex individualized at depth
+void wl_orbits_set_path(wl_orbits* o, int depth, int v);
+// Orbits of the node at depth from the automorphisms fixing path[0, depth)
+void wl_orbits_enter(wl_orbits* o, int depth);
+// Orbits of the node at depth taken from its child on the path, left just before, when the automorphisms found
+// that fix path[0, depth) all fix path[depth] too
+void wl_orbits_inherit(wl_orbits* o, int depth);
+void wl_orbits_leave(wl_orbits* o, int depth);
+// v is in the orbit of one of the count vertices explored
+bool wl_orbits_explored(wl_orbits* o, int depth, int v, const int* explored, int count);
+// Merges orbits with gamma at the active nodes up to depth whose paths it fixes pointwise, the deepest one being
+// entered first if needed, and stores it if it merged any : nodes entered later use the stored ones.
+// Returns true if it is stored
+bool wl_orbits_add(wl_orbits* o, int depth, int_array* gamma);
+// Same as wl_orbits_add, gamma being given by the pairs v, gamma(v) of the vertices it moves
+bool wl_orbits_add_moved(wl_orbits* o, int depth, int_array* moved);
+
+/*
+ * wl_workspace
+ *
+ * Buffers reused from one call to the next : reverse graphs and the initial partition
+ * target is the strategy of the searches, stats are accumulated until wl_workspace_free
+ */
+
+/*
+ * wl_frame
+ *
+ * Node of the path of a search, whose stack replaces recursion : its size is the depth of the search,
+ * which is only limited by memory. The candidates j of the node at depth k, out of end, give its progress
+ */
+
+typedef struct wl_frame {
+  int        depth;
+  int        c;          // target cell
+  int        size;       // of the target cell
+  const int* candidates; // on side 1
+  int        end;        // candidates kept, the others were given to other workers
+  int        j;          // candidate being searched, -1 before the first one
+  int        failed;     // last candidate which failed, -1 if none
+  long       used;       // nodes searched below it
+  long       nodes;      // nodes of the search when candidate j was individualized
+  arena_mark mark;       // arena before candidate j
+  int        cmp;        // canonical labeling : trace of the path down to the node against the best one
+} wl_frame;
+
+ARRAY_DECLARE(wl_frame_array, wl_frame)
+
+typedef struct wl_workspace {
+  graph           rg[2];
+  wl_partition    p;
+  int             target;
+  int_array       count;
+  wl_search_stats stats;
+  wl_orbits       orbits; // automorphisms of the second graph, or of the graph of a canonical form
+  wl_partition    q;      // searches of automorphisms
+  int_array       path;   // path.array[2 d + k] : vertex individualized at depth d on side k by the search
+  wl_frame_array  frames;   // path of the search in p
+  wl_frame_array  q_frames; // path of the search of an automorphism in q
+  long            report;   // nodes between progress lines on stderr, 0 : none. Not set in parallel workers
+  long            budget;   // nodes of a canonical labeling before it gives up, 0 : no limit
+} wl_workspace;
+
+wl_workspace wl_workspace_new();
+void wl_workspace_free(wl_workspace* ws);
+// Share of the search tree below the first frame which was searched, each candidate counting as much as the others
+// of its node. To be called from the thread of the search
+double wl_workspace_progress(const wl_workspace* ws);
+// Reverse graphs of g in the workspace, rg_ entries are used instead when they are not NULL nor empty
+void wl_workspace_reverse(wl_workspace* ws, graph* g[2], graph* rg_[2], graph* rg[2]);
+
+/*
+ * wl_search
+ *
+ * Search of an isomorphism from g[0] to g[1] in the partition of the workspace.
+ * Automorphisms of g[1] are searched in the partition q of the workspace, both sides holding g[1]
+ * parallel is NULL unless the search is a worker of wl_parallel.h
+ */
+
+struct wl_parallel;
+
+typedef struct wl_search {
+  graph*              g[2];
+  graph*              rg[2];
+  wl_workspace*       ws;
+  graph*              h[2];  // g[1] twice
+  graph*              rh[2];
+  long                budget;
+  struct wl_parallel* parallel;
+  int                 worker;
+  const int*          cancel; // set when another worker found an isomorphism, NULL if there is none
+  const int*          candidates; // candidates of the node at depth start on side 1, all its target cell if NULL
+  int                 ncandidates;
+  int                 start;
+} wl_search;
+
+static inline bool wl_search_cancelled(const wl_search* s){
+  return s->cancel != NULL && __atomic_load_n(s->cancel, __ATOMIC_RELAXED);
+}
+
+// rg_ as for wl_workspace_reverse, the automorphisms of the workspace are forgotten
+void wl_search_init(wl_search* s, wl_workspace* ws, graph* g[2], graph* rg_[2]);
+// Isomorphism extending the node at depth, whose partition is not stable yet. If one is found, the partition is
+// left discrete with the marks set below the node, otherwise those marks are undone
+// Iterative : the path below the node is pushed on ws->frames, and popped before it returns
+bool wl_backtrack(wl_search* s, int depth);
+
+/*
+ * graph_isomorphism_WL_*
+ * Returns int_array_empty() if graphs are not isomorphic
+ * Returns the isomorphism otherwise
+ *
+ * At each node, the last vertex of the target cell is individualized in the first graph, and each vertex of the cell
+ * in the second graph in turn. When a candidate fails, the next one is first mapped to it by an automorphism of the
+ * second graph fixing the path, looked for by a search of that graph against itself with at most as many nodes as
+ * the failed candidate used. Candidates in the orbit of a failed one are skipped
+ */
+int_array graph_isomorphism_WL_workspace(wl_workspace* ws, graph* g[2], graph* rg[2]);
+int_array graph_isomorphism_WL_reverse(graph* g[2], graph* rg[2]);
+int_array graph_isomorphism_WL(graph* g[2]);
+
+#endif
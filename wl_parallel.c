@@ -0,0 +1,314 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "wl_parallel.h"
+
+#include "pthread.h"
+#include "assert.h"
+
+#include "util.h"
+
+// Tasks tasks.array[front, size), taken ones before front
+typedef struct wl_deque {
+  pthread_mutex_t lock;
+  int_array_array tasks;
+  int             front;
+} wl_deque;
+
+typedef struct wl_worker {
+  wl_parallel*  par;
+  int           id;
+  pthread_t     thread;
+  bool          started;
+  wl_workspace* ws;  // the workspace of the search for worker 0, own for the others
+  wl_workspace  own;
+  wl_search     s;
+  wl_deque      deque;
+} wl_worker;
+
+/*
+ * Counters are read and written with atomic operations
+ * pending only reaches 0 once every task is done : a task is counted before the one that pushes it ends
+ */
+struct wl_parallel {
+  graph*          g[2];
+  graph*          rg[2];
+  wl_workspace*   ws;
+  wl_worker*      workers;
+  int             threads;
+  int             cancelled;
+  int             idle;    // workers waiting for a task
+  int             queued;  // tasks in the deques
+  int             pending; // tasks queued or being searched
+  pthread_mutex_t lock;    // wake and iso
+  pthread_cond_t  wake;
+  int_array       iso;
+};
+
+void wl_deque_init(wl_deque* d){
+  pthread_mutex_init(&d->lock, NULL);
+  d->tasks = int_array_array_empty();
+  d->front = 0;
+}
+
+void wl_deque_free(wl_deque* d){
+  for(int i = d->front; i < d->tasks.size; ++i){
+    int_array_free(&d->tasks.array[i]);
+  }
+  free(d->tasks.array);
+  pthread_mutex_destroy(&d->lock);
+}
+
+void wl_parallel_broadcast(wl_parallel* par){
+  pthread_mutex_lock(&par->lock);
+  pthread_cond_broadcast(&par->wake);
+  pthread_mutex_unlock(&par->lock);
+}
+
+bool wl_parallel_hungry(wl_parallel* par){
+  return __atomic_load_n(&par->idle, __ATOMIC_RELAXED) > 0 && __atomic_load_n(&par->queued, __ATOMIC_RELAXED) == 0;
+}
+
+// A task holds its depth, its path and its candidates
+void wl_parallel_push(wl_parallel* par, int worker, const int* path, int depth, const int* candidates, int count){
+  int_array task = int_array_new(1 + 2 * depth + count);
+  task.array[0] = depth;
+  for(int i = 0; i < 2 * depth; ++i){
+    task.array[1 + i] = path[i];
+  }
+  for(int i = 0; i < count; ++i){
+    task.array[1 + 2 * depth + i] = candidates[i];
+  }
+  __atomic_add_fetch(&par->pending, 1, __ATOMIC_SEQ_CST);
+  wl_deque* d = &par->workers[worker].deque;
+  pthread_mutex_lock(&d->lock);
+  int_array_array_append(&d->tasks, task);
+  __atomic_add_fetch(&par->queued, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&d->lock);
+  wl_parallel_broadcast(par);
+}
+
+// Last task of the deque, or first one if steal
+bool wl_deque_take(wl_parallel* par, wl_deque* d, bool steal, int_array* task){
+  pthread_mutex_lock(&d->lock);
+  bool taken = d->front < d->tasks.size;
+  if(taken){
+    if(steal){
+      *task = d->tasks.array[d->front];
+      d->front += 1;
+    }else{
+      d->tasks.size -= 1;
+      *task = d->tasks.array[d->tasks.size];
+    }
+    if(d->front == d->tasks.size){
+      d->front = d->tasks.size = 0;
+    }
+    __atomic_sub_fetch(&par->queued, 1, __ATOMIC_SEQ_CST);
+  }
+  pthread_mutex_unlock(&d->lock);
+  return taken;
+}
+
+bool wl_parallel_take(wl_parallel* par, int worker, int_array* task){
+  if(wl_deque_take(par, &par->workers[worker].deque, false, task)){
+    return true;
+  }
+  for(int i = 1; i < par->threads; ++i){
+    if(wl_deque_take(par, &par->workers[(worker + i) % par->threads].deque, true, task)){
+      return true;
+    }
+  }
+  return false;
+}
+
+// Replays the path of the task from the root partition, searches below it and rewinds everything
+void wl_parallel_search(wl_worker* w, int_array* task){
+  wl_parallel* par = w->par;
+  wl_partition* p = &w->ws->p;
+  int depth = task->array[0];
+  wl_partition_mark(p);
+  for(int d = 0; d < depth; ++d){
+    int* a = task->array + 1 + 2 * d;
+    // The parents of the node were stable
+    bool valid = d == 0 || stable_partition(par->g, par->rg, p);
+    assert(valid);
+    (void) valid;
+    int c = p->elements[0].array[a[0]];
+    assert(p->elements[1].array[a[1]] == c && p->cell_size.array[c] > 1);
+    wl_orbits_set_path(&w->ws->orbits, d, a[1]);
+    w->ws->path.array[2 * d]     = a[0];
+    w->ws->path.array[2 * d + 1] = a[1];
+    wl_individualize(par->g, par->rg, p, c, a);
+  }
+  w->s.start       = depth;
+  w->s.ncandidates = task->size - 1 - 2 * depth;
+  w->s.candidates  = w->s.ncandidates != 0 ? task->array + 1 + 2 * depth : NULL;
+  if(wl_backtrack(&w->s, depth)){
+    pthread_mutex_lock(&par->lock);
+    if(!__atomic_load_n(&par->cancelled, __ATOMIC_SEQ_CST)){
+      par->iso = int_array_new(p->size);
+      for(int j = 0; j < p->size; ++j){
+        par->iso.array[p->perm[0].array[j]] = p->perm[1].array[j];
+      }
+      __atomic_store_n(&par->cancelled, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_cond_broadcast(&par->wake);
+    pthread_mutex_unlock(&par->lock);
+  }
+  while(p->trail_size > 0){
+    wl_partition_undo(p);
+  }
+}
+
+/*
+ * Workspace of worker id, whose root partition is the stable one of ws : ws itself for worker 0,
+ * a copy for the others, made before worker 0 changes it
+ */
+void wl_worker_init(wl_worker* w, wl_parallel* par, int id){
+  w->par     = par;
+  w->id      = id;
+  w->started = id == 0;
+  w->ws      = id == 0 ? par->ws : &w->own;
+  if(id != 0){
+    w->own        = wl_workspace_new();
+    w->own.p      = wl_partition_copy(&par->ws->p);
+    w->own.target = par->ws->target;
+  }
+  wl_deque_init(&w->deque);
+}
+
+// Search state of the tasks, in the thread of the worker
+void wl_worker_start(wl_worker* w){
+  wl_parallel* par = w->par;
+  wl_search_init(&w->s, w->ws, par->g, par->rg);
+  w->s.parallel = par;
+  w->s.worker   = w->id;
+  w->s.cancel   = &par->cancelled;
+}
+
+void* wl_parallel_worker(void* arg){
+  wl_worker* w = arg;
+  wl_parallel* par = w->par;
+  wl_worker_start(w);
+  while(true){
+    int_array task;
+    if(!wl_parallel_take(par, w->id, &task)){
+      pthread_mutex_lock(&par->lock);
+      __atomic_add_fetch(&par->idle, 1, __ATOMIC_SEQ_CST);
+      while(__atomic_load_n(&par->queued, __ATOMIC_SEQ_CST) == 0
+            && __atomic_load_n(&par->pending, __ATOMIC_SEQ_CST) != 0
+            && !__atomic_load_n(&par->cancelled, __ATOMIC_SEQ_CST)){
+        pthread_cond_wait(&par->wake, &par->lock);
+      }
+      __atomic_sub_fetch(&par->idle, 1, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&par->lock);
+      if(__atomic_load_n(&par->pending, __ATOMIC_SEQ_CST) == 0 || __atomic_load_n(&par->cancelled, __ATOMIC_SEQ_CST)){
+        break;
+      }
+      continue;
+    }
+    if(!__atomic_load_n(&par->cancelled, __ATOMIC_SEQ_CST)){
+      wl_parallel_search(w, &task);
+    }
+    int_array_free(&task);
+    if(__atomic_sub_fetch(&par->pending, 1, __ATOMIC_SEQ_CST) == 0){
+      wl_parallel_broadcast(par);
+    }
+  }
+  return NULL;
+}
+
+// Statistics of the other workers are added to those of the workspace of the search
+void wl_worker_free(wl_worker* w){
+  wl_deque_free(&w->deque);
+  if(w->id == 0){
+    return;
+  }
+  if(w->started){
+    wl_search_stats* st = &w->par->ws->stats;
+    st->nodes         += w->own.stats.nodes;
+    st->failures      += w->own.stats.failures;
+    st->automorphisms += w->own.stats.automorphisms;
+    st->pruned        += w->own.stats.pruned;
+    if(w->own.stats.depth > st->depth){
+      st->depth = w->own.stats.depth;
+    }
+    wl_refine_stats* rs = &w->par->ws->p.stats;
+    rs->refinements += w->own.p.stats.refinements;
+    rs->splits      += w->own.p.stats.splits;
+    rs->visits      += w->own.p.stats.visits;
+    rs->collisions  += w->own.p.stats.collisions;
+    arena_stats* as = &w->par->ws->p.arena.stats;
+    if(w->own.p.arena.stats.peak > as->peak){
+      as->peak = w->own.p.arena.stats.peak;
+    }
+    as->allocations += w->own.p.arena.stats.allocations;
+    as->releases    += w->own.p.arena.stats.releases;
+  }
+  wl_workspace_free(&w->own);
+}
+
+/*
+ * The calling thread is worker 0, it searches in ws
+ * When a thread can't be created, the search goes on with the workers started
+ */
+int_array graph_isomorphism_WL_parallel(wl_workspace* ws, graph* g[2], graph* rg_[2], int threads){
+  TWICE(i) assert(g[i] != NULL);
+  assert(ws != NULL && threads >= 1);
+  if(g[0]->size != g[1]->size){
+    return int_array_empty();
+  }
+  wl_search s;
+  wl_search_init(&s, ws, g, rg_);
+  wl_partition* p = &ws->p;
+  bool valid = wl_graph_degree_partition_into(g, p) && stable_partition(s.g, s.rg, p);
+  if(!valid || wl_partition_is_discrete(p)){
+    // No search needed
+    int_array iso = int_array_empty();
+    if(valid){
+      iso = int_array_new(p->size);
+      for(int j = 0; j < p->size; ++j){
+        iso.array[p->perm[0].array[j]] = p->perm[1].array[j];
+      }
+    }
+    return iso;
+  }
+
+  wl_parallel par;
+  TWICE(i){
+    par.g[i]  = s.g[i];
+    par.rg[i] = s.rg[i];
+  }
+  par.ws        = ws;
+  par.threads   = threads;
+  par.cancelled = 0;
+  par.idle      = 0;
+  par.queued    = 0;
+  par.pending   = 0;
+  par.iso       = int_array_empty();
+  pthread_mutex_init(&par.lock, NULL);
+  pthread_cond_init(&par.wake, NULL);
+  par.workers = malloc(threads * sizeof(wl_worker));
+  // The root is refined once, in ws
+  for(int i = 0; i < threads; ++i){
+    wl_worker_init(&par.workers[i], &par, i);
+  }
+  // The root
+  wl_parallel_push(&par, 0, NULL, 0, NULL, 0);
+  for(int i = 1; i < threads; ++i){
+    wl_worker* w = &par.workers[i];
+    w->started = pthread_create(&w->thread, NULL, wl_parallel_worker, w) == 0;
+  }
+  wl_parallel_worker(&par.workers[0]);
+  for(int i = 1; i < threads; ++i){
+    if(par.workers[i].started){
+      pthread_join(par.workers[i].thread, NULL);
+    }
+  }
+  for(int i = 0; i < threads; ++i){
+    wl_worker_free(&par.workers[i]);
+  }
+  free(par.workers);
+  pthread_cond_destroy(&par.wake);
+  pthread_mutex_destroy(&par.lock);
+  return par.iso;
+}
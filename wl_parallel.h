@@ -0,0 +1,38 @@
+#ifndef ALGO_GISO_WL_PARALLEL_H
+#define ALGO_GISO_WL_PARALLEL_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "array.h"
+#include "graph.h"
+#include "wl.h"
+
+/*
+ * Parallel WL search
+ *
+ * Each worker thread searches in its own workspace, the one of the caller for the calling thread, the graphs
+ * and their reverse graphs are shared and read only. The root is refined once, the other workers start from copies.
+ * A task is a node of the search tree, given by the pairs individualized on its path from the root, and some of
+ * its candidates : the worker replays the path from its root partition under a mark, searches below the node
+ * with wl_backtrack, trying only those candidates, and undoes it all.
+ *
+ * Work stealing : every worker has a deque of tasks, takes its own last one, the deepest, and when it is empty,
+ * steals the first one of another worker, the shallowest. When a worker is idle and no task is queued,
+ * the node being searched gives the upper half of its remaining candidates away as a task.
+ * The first worker finding an isomorphism cancels the others, which stop at their next node.
+ *
+ * Automorphisms are found and kept by each worker : orbits only prune the candidates of a task among themselves
+ */
+
+typedef struct wl_parallel wl_parallel;
+
+// A worker waits for a task and none is queued
+bool wl_parallel_hungry(wl_parallel* par);
+// Queues the node at depth whose path is given by the pairs path[2 d], path[2 d + 1], d < depth,
+// with count candidates, all of them if count is 0
+void wl_parallel_push(wl_parallel* par, int worker, const int* path, int depth, const int* candidates, int count);
+
+// Same as graph_isomorphism_WL_workspace with threads workers, their statistics are added to those of ws
+int_array graph_isomorphism_WL_parallel(wl_workspace* ws, graph* g[2], graph* rg[2], int threads);
+
+#endif
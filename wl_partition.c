@@ -2,19 +2,17 @@
 
 #include "stdio.h"
 
-int wl_hash_f(int i){
-  return i;
-}
-
 void wl_print_partition(wl_partition* p){
-  for(int i = 0; i < p->partition.size; ++i) if(p->partition.array[i][0].size != 0) {
-    printf("%d : \n", i);
+  for(int s = 0; s < p->size; s = wl_partition_next(p, s)){
+    printf("%d : \n", s);
     TWICE(k){
       printf("\t");
-      for(int j = 0; j < p->partition.array[i][k].size; ++j){
-        printf("%d(%d) ", p->partition.array[i][k].array[j], p->elements_hash[k].array[p->partition.array[i][k].array[j]]);
+      for(int j = s; j < wl_partition_next(p, s); ++j){
+        int v = p->perm[k].array[j];
+        printf("%d(%016llx) ", v, (unsigned long long) wl_partition_hash(p, k, v));
         fflush(stdout);
-        assert(p->elements[k].array[p->partition.array[i][k].array[j]] == i);
+        assert(p->elements[k].array[v] == s);
+        assert(p->position[k].array[v] == j);
       }
       printf("\n");
     }
@@ -23,126 +21,304 @@ void wl_print_partition(wl_partition* p){
 
 wl_partition wl_partition_empty(){
   wl_partition p;
-  p.partition		      = int_array_pair_array_empty();
-  TWICE(i) p.elements[i]      = int_array_empty();
-  TWICE(i) p.elements_hash[i] = int_array_empty();
-  p.update_queue	      = int_set_empty();
+  p.size             = 0;
+  p.cells            = 0;
+  TWICE(i){
+    p.perm[i]          = int_array_empty();
+    p.position[i]      = int_array_empty();
+    p.elements[i]      = int_array_empty();
+    TWICE(lane) p.elements_hash[i][lane] = NULL;
+  }
+  p.cell_size        = int_array_empty();
+  p.keys             = NULL;
+  p.sorted           = NULL;
+  p.update_queue     = int_worklist_empty();
+  p.trail            = NULL;
+  p.trail_size       = 0;
+  p.trail_bufferSize = 0;
+  p.trail_saved      = int_array_empty();
+  p.refine           = WL_REFINE_HOPCROFT;
+  p.check            = false;
+  TWICE(i){
+    TWICE(lane) p.count[i][lane] = int_array_empty();
+    p.touched[i]      = int_array_empty();
+    p.cell_touched[i] = int_array_empty();
+  }
+  p.touched_cells    = int_array_empty();
+  p.touched_count    = int_array_empty();
+  p.bound            = int_array_empty();
+  p.pool             = NULL;
+  p.arena            = arena_empty();
+  p.stats.refinements = p.stats.splits = p.stats.visits = p.stats.collisions = 0;
   return p;
 }
 
 bool wl_partition_is_empty(wl_partition* p){
   assert(p != NULL);
-  return p->partition.size == 0 && p->elements[0].size == 0;
+  return p->size == 0 && p->perm[0].array == NULL;
 }
 
-wl_partition wl_partition_new(int size){
-  wl_partition p;
-  p.partition		      = int_array_pair_array_empty();
-  TWICE(i) {
-    p.elements[i]      = int_array_new(size);
-    p.elements_hash[i] = int_array_new(size);
-    for(int j = 0; j < size; ++j){
-      p.elements[i].array[j]      = -1;
-      p.elements_hash[i].array[j] = 42;
+void wl_partition_reset_exact(wl_partition* p, int size){
+  TWICE(i){
+    TWICE(lane){
+      int_array_reserve(&p->count[i][lane], size);
+      p->count[i][lane].size = size;
+      memset(p->count[i][lane].array, 0, size * sizeof(int));
     }
+    int_array_reserve(&p->touched[i], size);
+    p->touched[i].size = 0;
+    int_array_reserve(&p->cell_touched[i], size);
+    p->cell_touched[i].size = size;
+    memset(p->cell_touched[i].array, 0, size * sizeof(int));
   }
-  p.update_queue	      = int_set_empty();
-  return p;
+  int_array_reserve(&p->touched_cells, size);
+  p->touched_cells.size = 0;
+  int_array_reserve(&p->touched_count, size);
+  p->touched_count.size = 0;
+  int_array_reserve(&p->bound, size + 1);
+  p->bound.size = size + 1;
 }
 
-wl_partition wl_partition_new_with_classes(int size, int cls_size){
-  wl_partition p = wl_partition_new(size);
-  p.partition    = int_array_pair_array_new(cls_size);
+wl_partition wl_partition_new(int size){
+  wl_partition p = wl_partition_empty();
+  wl_partition_reset(&p, size);
   return p;
 }
 
+void wl_partition_reset(wl_partition* p, int size){
+  assert(p != NULL);
+  bool grow = size > p->size || p->keys == NULL;
+  p->size = size;
+  p->cells = size > 0 ? 1 : 0;
+  TWICE(i){
+    int_array* a[3] = { &p->perm[i], &p->position[i], &p->elements[i] };
+    for(int j = 0; j < 3; ++j){
+      int_array_reserve(a[j], size);
+      a[j]->size = size;
+    }
+    TWICE(lane){
+      if(grow){
+        free(p->elements_hash[i][lane]);
+        p->elements_hash[i][lane] = malloc(((size_t) size + 1) * sizeof(uint64_t));
+      }
+      memset(p->elements_hash[i][lane], 0, size * sizeof(uint64_t));
+    }
+    for(int v = 0; v < size; ++v){
+      p->perm[i].array[v]     = v;
+      p->position[i].array[v] = v;
+      p->elements[i].array[v] = 0;
+    }
+  }
+  int_array_reserve(&p->cell_size, size);
+  p->cell_size.size = size;
+  if(size > 0){
+    p->cell_size.array[0] = size;
+  }
+  if(grow){
+    free(p->keys);
+    p->keys = malloc((2 * (size_t) size + 1) * sizeof(hash_key));
+    free(p->sorted);
+    p->sorted = malloc(((size_t) size + 1) * sizeof(hash_key));
+  }
+  int_worklist_reserve(&p->update_queue, size);
+  int_worklist_clear(&p->update_queue);
+  wl_partition_trail_clear(p);
+  if(p->refine == WL_REFINE_EXACT){
+    wl_partition_reset_exact(p, size);
+  }
+}
+
 wl_partition wl_partition_copy(wl_partition* p){
-  wl_partition q;
-  q.partition = int_array_pair_array_copy(&p->partition);
+  wl_partition q = wl_partition_empty();
+  q.size  = p->size;
+  q.cells = p->cells;
   TWICE(i){
+    q.perm[i]          = int_array_copy(&p->perm[i]);
+    q.position[i]      = int_array_copy(&p->position[i]);
     q.elements[i]      = int_array_copy(&p->elements[i]);
-    q.elements_hash[i] = int_array_copy(&p->elements_hash[i]);
+    TWICE(lane){
+      q.elements_hash[i][lane] = malloc(((size_t) p->size + 1) * sizeof(uint64_t));
+      memcpy(q.elements_hash[i][lane], p->elements_hash[i][lane], p->size * sizeof(uint64_t));
+    }
   }
-  q.update_queue = int_set_copy(&p->update_queue);
-
+  q.cell_size    = int_array_copy(&p->cell_size);
+  q.keys         = malloc((2 * (size_t) p->size + 1) * sizeof(hash_key));
+  q.sorted       = malloc(((size_t) p->size + 1) * sizeof(hash_key));
+  q.update_queue = int_worklist_copy(&p->update_queue);
+  q.refine       = p->refine;
+  q.check        = p->check;
+  // Only the buffers : counts are 0 between splitters
+  if(q.refine == WL_REFINE_EXACT){
+    wl_partition_reset_exact(&q, q.size);
+  }
+  // The trail, the arena and the statistics are not copied
   return q;
 }
 
 void wl_partition_free(wl_partition* p){
   assert(p != NULL);
-  int_array_pair_array_free(&p->partition);
   TWICE(i){
+    int_array_free(&p->perm[i]);
+    int_array_free(&p->position[i]);
     int_array_free(&p->elements[i]);
-    int_array_free(&p->elements_hash[i]);
+    TWICE(lane) free(p->elements_hash[i][lane]);
+  }
+  int_array_free(&p->cell_size);
+  free(p->keys);
+  free(p->sorted);
+  int_worklist_free(&p->update_queue);
+  free(p->trail);
+  int_array_free(&p->trail_saved);
+  TWICE(i){
+    TWICE(lane) int_array_free(&p->count[i][lane]);
+    int_array_free(&p->touched[i]);
+    int_array_free(&p->cell_touched[i]);
   }
-  int_set_free(&p->update_queue);
+  int_array_free(&p->touched_cells);
+  int_array_free(&p->touched_count);
+  int_array_free(&p->bound);
+  arena_free(&p->arena);
 }
 
-int wl_partition_new_class(wl_partition* p){
+void wl_partition_place(wl_partition* p, int k, int s, int size, const hash_key* keys){
+  for(int j = 0; j < size; ++j){
+    int v = keys[j].value;
+    p->perm[k].array[s + j]  = v;
+    p->position[k].array[v] = s + j;
+  }
+}
+
+int wl_partition_split(wl_partition* p, int s, int from, const hash_key* keys){
   assert(p != NULL);
-  int cls = p->partition.size;
-  int_array a[2] = { int_array_empty(), int_array_empty() };
-  int_array_pair_array_append(&p->partition, a);
-  return cls;
+  int end = wl_partition_next(p, s);
+  assert(from >= s && from < end);
+  int fragments = 1;
+  int t = s;
+  if(from > s){
+    p->cell_size.array[s] = from - s;
+    t = from;
+    fragments += 1;
+    TWICE(k) p->elements[k].array[p->perm[k].array[from]] = t;
+  }
+  for(int j = from + 1; j < end; ++j){
+    assert(keys[j-from].value == p->perm[0].array[j]);
+    if(keys[j-from].hash != keys[j-from-1].hash){
+      p->cell_size.array[t] = j - t;
+      t = j;
+      fragments += 1;
+    }
+    if(t != s){
+      TWICE(k) p->elements[k].array[p->perm[k].array[j]] = t;
+    }
+  }
+  p->cell_size.array[t] = end - t;
+  p->cells += fragments - 1;
+  return fragments;
 }
 
-void wl_partition_set_class(wl_partition* p, int cls, int a[2]){
+int wl_partition_individualize(wl_partition* p, int s, int a[2]){
   assert(p != NULL);
-  TWICE(i) assert(a[i] >= 0 && a[i] < p->elements[i].size);
-  assert(cls >= 0 && cls < p->partition.size);
+  int size = p->cell_size.array[s];
+  assert(size > 1);
+  int t = s + size - 1;
+  int former[2];
+  TWICE(k){
+    assert(p->elements[k].array[a[k]] == s);
+    former[k] = p->position[k].array[a[k]];
+    int b = p->perm[k].array[t];
+    p->perm[k].array[former[k]] = b;
+    p->position[k].array[b]     = former[k];
+    p->perm[k].array[t]         = a[k];
+    p->position[k].array[a[k]]  = t;
+    p->elements[k].array[a[k]]  = t;
+  }
+  if(p->trail_size != 0){
+    wl_partition_trail_push(p, WL_TRAIL_INDIVIDUALIZE, s, size, former[0], former[1]);
+  }
+  p->cell_size.array[s] = size - 1;
+  p->cell_size.array[t] = 1;
+  p->cells += 1;
+  return t;
+}
 
-  TWICE(i){
-    // p->elements_hash[i].array[a[i]] += hash_f(cls) - hash_f(p->elements[i].array[a[i]]);
-    p->elements[i].array[a[i]] = cls;
-    int_array_append(&p->partition.array[cls][i], a[i]);
+void wl_partition_trail_push(wl_partition* p, int kind, int a, int b, int c, int d){
+  if(p->trail_size == p->trail_bufferSize){
+    p->trail_bufferSize = (3 * p->trail_bufferSize) / 2 + 16;
+    p->trail = realloc(p->trail, p->trail_bufferSize * sizeof(wl_trail_entry));
   }
+  wl_trail_entry* e = &p->trail[p->trail_size];
+  e->kind = kind;
+  e->a    = a;
+  e->b    = b;
+  e->c    = c;
+  e->d    = d;
+  p->trail_size += 1;
 }
 
-void wl_partition_set_class_single(wl_partition* p, int cls, int i, int a){
+void wl_partition_save(wl_partition* p, int s){
   assert(p != NULL);
-  assert(i == 0 || i == 1);
-  assert(a >= 0 && a < p->elements[i].size);
-  assert(cls >= 0 && cls < p->partition.size);
+  if(p->trail_size == 0){
+    return;
+  }
+  int size = p->cell_size.array[s];
+  wl_partition_trail_push(p, WL_TRAIL_SPLIT, s, size, p->trail_saved.size, 0);
+  int_array_reserve(&p->trail_saved, p->trail_saved.size + 2 * size);
+  TWICE(k){
+    memcpy(p->trail_saved.array + p->trail_saved.size, p->perm[k].array + s, size * sizeof(int));
+    p->trail_saved.size += size;
+  }
+}
 
-  // p->elements_hash[i].array[a] += hash_f(cls) - hash_f(p->elements[i].array[a]);
-  p->elements[i].array[a] = cls;
-  int_array_append(&p->partition.array[cls][i], a);
+void wl_partition_mark(wl_partition* p){
+  assert(p != NULL);
+  assert(int_worklist_is_empty(&p->update_queue));
+  wl_partition_trail_push(p, WL_TRAIL_MARK, p->cells, 0, 0, 0);
 }
 
-// false if partition is invalid (classes with different sizes)
-bool wl_partition_cleanup(wl_partition* p){
+void wl_partition_undo(wl_partition* p){
   assert(p != NULL);
-  
-  int_array mapping = int_array_new(p->partition.size);
-  int cur = 0;
-  int_array_pair_array np = int_array_pair_array_empty();
-  for(int i = 0; i < p->partition.size; ++i){
-    if(p->partition.array[i][0].size != p->partition.array[i][1].size){
-      // TODO : free here
-      return false;
-    }
-    if(p->partition.array[i][0].size != 0){
-      TWICE(k) for(int j = 0; j < p->partition.array[i][k].size; ++j){
-	// p->elements_hash[k].array[p->partition.array[i][k].array[j]] += hash_f(cur) - hash_f(p->elements[k].array[p->partition.array[i][k].array[j]]);
-        p->elements[k].array[p->partition.array[i][k].array[j]] = cur;
+  assert(p->trail_size > 0);
+  while(true){
+    p->trail_size -= 1;
+    wl_trail_entry* e = &p->trail[p->trail_size];
+    if(e->kind == WL_TRAIL_MARK){
+      p->cells = e->a;
+      break;
+    }else if(e->kind == WL_TRAIL_HASH){
+      p->elements_hash[e->a / 2][e->a % 2][e->b] = (uint64_t) (uint32_t) e->c | (uint64_t) (uint32_t) e->d << 32;
+    }else if(e->kind == WL_TRAIL_SPLIT){
+      int s = e->a, size = e->b;
+      TWICE(k){
+        int* saved = p->trail_saved.array + e->c + k * size;
+        for(int j = 0; j < size; ++j){
+          p->perm[k].array[s + j]            = saved[j];
+          p->position[k].array[saved[j]]     = s + j;
+          p->elements[k].array[saved[j]]     = s;
+        }
       }
-      mapping.array[i] = cur;
-      int_array_pair_array_append(&np, p->partition.array[i]);
-      TWICE(j) p->partition.array[i][j] = int_array_empty();
-      cur += 1;
+      p->cell_size.array[s] = size;
+      p->trail_saved.size = e->c;
+    }else{
+      assert(e->kind == WL_TRAIL_INDIVIDUALIZE);
+      int s = e->a, size = e->b, t = s + size - 1;
+      int former[2] = { e->c, e->d };
+      TWICE(k){
+        int a = p->perm[k].array[t];
+        int b = p->perm[k].array[former[k]];
+        p->perm[k].array[t]         = b;
+        p->position[k].array[b]     = t;
+        p->perm[k].array[former[k]] = a;
+        p->position[k].array[a]     = former[k];
+        p->elements[k].array[a]     = s;
+      }
+      p->cell_size.array[s] = size;
     }
   }
-  
-  int mapping_f(int i){
-    return mapping.array[i];
-  }
-
-  int_set_map_monotonous(&p->update_queue, mapping_f);
-  
-  int_array_free(&mapping);
-  int_array_pair_array_free(&p->partition);
-  p->partition = np;
-
-  return true;
+  int_worklist_clear(&p->update_queue);
 }
 
+void wl_partition_trail_clear(wl_partition* p){
+  assert(p != NULL);
+  p->trail_size       = 0;
+  p->trail_saved.size = 0;
+}
@@ -3,32 +3,174 @@
 
 #include "stdlib.h"
 #include "stdbool.h"
+#include "stdint.h"
 #include "array.h"
-#include "set.h"
+#include "worklist.h"
+#include "thread_pool.h"
+
+/*
+ * wl_partition
+ *
+ * Ordered partition of the vertices of two graphs of the same size
+ * Each side is a permutation of its vertices, a cell is a range [s, s + cell_size[s]) of positions,
+ * identified by its first position s, the same on both sides.
+ * Splitting a cell rearranges its range in place : the largest fragment comes first and keeps the cell number,
+ * the other ones follow in hash order and are numbered by their first position. Cell numbers only depend
+ * on the sizes and the hashes of the fragments, not on vertex labels.
+ *
+ * Memory : perm, position, elements, elements_hash per side and vertex, cell_size per position,
+ * and sort buffers, all allocated once
+ */
+
+/*
+ * Hashes
+ *
+ * The hash of a vertex v is kept in two 64 bits lanes, sums of wl_hash_f over the cells of the vertices u
+ * such that v is a neighbour of u : in g for the forward lane, in the reverse graph for the reverse lane.
+ * Sums are updated incrementally when a cell is split, the lanes are combined by wl_partition_hash.
+ * A collision is two vertices with the same hash whose multisets of neighbouring cells differ
+ */
+
+#define WL_LANE_FORWARD 0
+#define WL_LANE_REVERSE 1
+
+/*
+ * Trail
+ *
+ * Once a mark is set, changes are recorded so that wl_partition_undo can rewind them :
+ * old hashes, the order of the cells that were split, individualized vertices.
+ * The update queue is emptied.
+ * Memory used by a search node is proportional to the changes it makes, the partition is never copied
+ */
+
+#define WL_TRAIL_MARK          0 // a : number of cells
+#define WL_TRAIL_HASH          1 // a : 2 side + lane, b : vertex, c and d : low and high bits of the old hash
+#define WL_TRAIL_SPLIT         2 // a : cell, b : size, c : offset of both permutations of the cell in trail_saved
+#define WL_TRAIL_INDIVIDUALIZE 3 // a : cell, b : size, c and d : former positions of the vertices on each side
+
+typedef struct wl_trail_entry {
+  int kind;
+  int a;
+  int b;
+  int c;
+  int d;
+} wl_trail_entry;
+
+/*
+ * Refinement modes, the first two give the same partitions
+ * WL_REFINE_NAIVE    : after a split, the neighbours of all the vertices of the cell are marked
+ * WL_REFINE_HOPCROFT : only the fragments other than the largest one are used as splitters,
+ *                      O((n + m) log n) refinement
+ * WL_REFINE_EXACT    : no hashes, the queue holds splitters. The neighbours of each vertex in the splitter
+ *                      are counted in both directions, and the cells they touch are split by those counts.
+ *                      Only the touched vertices are moved, to the end of their cell, and sorted.
+ *                      All the fragments but the largest one become splitters, cells come in another order
+ */
+#define WL_REFINE_NAIVE    0
+#define WL_REFINE_HOPCROFT 1
+#define WL_REFINE_EXACT    2
+
+typedef struct wl_refine_stats {
+  long refinements; // cells taken from the update queue
+  long splits;      // cells split
+  long visits;      // edges scanned to mark cells and update hashes
+  long collisions;  // vertices found with the hash of their cell but not its neighbouring cells
+} wl_refine_stats;
 
 typedef struct wl_partition {
-  int_array_pair_array partition;
-  int_array            elements[2];
-  int_array            elements_hash[2];
-  int_set              update_queue;
+  int             size;
+  int             cells;
+  int_array       perm[2];
+  int_array       position[2];      // position[k].array[v] : index of v in perm[k]
+  int_array       elements[2];      // elements[k].array[v] : cell of v
+  uint64_t*       elements_hash[2][2]; // elements_hash[k][lane][v]
+  int_array       cell_size;        // cell_size.array[s] : size of the cell s, meaningless if s isn't a cell
+  hash_key*       keys;             // sort buffer of 2 size + 1 keys
+  hash_key*       sorted;           // second sort buffer of size + 1 keys
+  int_worklist    update_queue;
+  wl_trail_entry* trail;
+  int             trail_size;
+  int             trail_bufferSize;
+  int_array       trail_saved;
+  int             refine;           // kept by wl_partition_reset
+  bool            check;            // looks for collisions in every stable partition, O(m log m)
+  // WL_REFINE_EXACT buffers, allocated by wl_partition_reset in that mode
+  int_array       count[2][2];      // count[k][lane][v] : neighbours of v in the splitter, 0 between splitters
+  int_array       touched[2];       // vertices with a non zero count
+  int_array       cell_touched[2];  // cell_touched[k].array[s] : touched vertices of cell s, 0 between splitters
+  int_array       touched_cells;
+  int_array       touched_count;    // touched vertices of each touched cell, on each side
+  int_array       bound;            // counting sort buffer of size + 1 counters
+  thread_pool*    pool;             // parallel refinement of large cells, NULL : serial. Not owned, nor copied
+  arena           arena;            // scratch memory of the search, released when a node is left. Not copied
+  wl_refine_stats stats;            // accumulated until wl_partition_free
 } wl_partition;
 
-int wl_hash_f(int i);
+// Finalizer of splitmix64
+static inline uint64_t wl_mix(uint64_t x){
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  return x;
+}
+
+// Contribution of cell c to the hashes of the neighbours of its vertices
+static inline uint64_t wl_hash_f(int c){
+  return wl_mix((uint64_t) c + 0x9E3779B97F4A7C15ull);
+}
 
 void wl_print_partition(wl_partition* p);
 
 wl_partition wl_partition_empty();
 bool wl_partition_is_empty(wl_partition* p);
+// A single cell with all vertices
 wl_partition wl_partition_new(int size);
-wl_partition wl_partition_new_with_classes(int size, int cls_size);
 void wl_partition_free(wl_partition* p);
+// Same as wl_partition_new, keeping the buffers of p
+void wl_partition_reset(wl_partition* p, int size);
 wl_partition wl_partition_copy(wl_partition* p);
-bool wl_partition_cleanup(wl_partition* p);
-int wl_partition_new_class(wl_partition* p);
-void wl_partition_set_class(wl_partition* p, int cls, int a[2]);
-void wl_partition_set_class_single(wl_partition* p, int cls, int i, int a);
-/* int partition_new_class(partition* p); */
-/* void partition_clear_class(partition* p, int cls); */
-/* void partition_set_class(partition* p, int el, int cls); */
+
+// Both lanes of v on side k
+static inline uint64_t wl_partition_hash(const wl_partition* p, int k, int v){
+  return wl_mix(p->elements_hash[k][WL_LANE_FORWARD][v] + wl_mix(p->elements_hash[k][WL_LANE_REVERSE][v]));
+}
+
+static inline bool wl_partition_is_discrete(const wl_partition* p){
+  return p->cells == p->size;
+}
+
+// First position of the next cell
+static inline int wl_partition_next(const wl_partition* p, int s){
+  return s + p->cell_size.array[s];
+}
+
+// Writes perm[k][s..s+size) back from the values of keys and updates positions
+void wl_partition_place(wl_partition* p, int k, int s, int size, const hash_key* keys);
+// Splits cell s into fragments of equal hashes : [s, from) is the first one if it isn't empty,
+// the vertices of [from, end of s) being placed from keys, sorted by hash on side 0, with greater hashes
+// Returns the number of fragments
+int wl_partition_split(wl_partition* p, int s, int from, const hash_key* keys);
+// Moves a[k] to the end of cell s on both sides, in a new singleton cell, returns that cell
+int wl_partition_individualize(wl_partition* p, int s, int a[2]);
+
+void wl_partition_trail_push(wl_partition* p, int kind, int a, int b, int c, int d);
+// Saves the order of cell s before it is rearranged, if a mark is set
+void wl_partition_save(wl_partition* p, int s);
+// The update queue has to be empty
+void wl_partition_mark(wl_partition* p);
+// Rewinds the changes made since the last mark, and removes it
+void wl_partition_undo(wl_partition* p);
+// Forgets all marks, the current state is kept
+void wl_partition_trail_clear(wl_partition* p);
+
+static inline void wl_partition_add_hash(wl_partition* p, int side, int lane, int i, uint64_t delta){
+  uint64_t* h = &p->elements_hash[side][lane][i];
+  if(p->trail_size != 0){
+    wl_partition_trail_push(p, WL_TRAIL_HASH, 2 * side + lane, i, (int) (uint32_t) *h, (int) (uint32_t) (*h >> 32));
+  }
+  *h += delta;
+}
 
 #endif
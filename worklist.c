@@ -0,0 +1,138 @@
+#include "worklist.h"
+
+#include "stdio.h"
+#include "string.h"
+
+int_worklist int_worklist_empty(){
+  int_worklist w;
+  w.size     = 0;
+  w.capacity = 0;
+  w.levels   = 0;
+  for(int l = 0; l < INT_WORKLIST_LEVELS; ++l){
+    w.bits[l]  = NULL;
+    w.words[l] = 0;
+  }
+  return w;
+}
+
+int_worklist int_worklist_new(int capacity){
+  int_worklist w = int_worklist_empty();
+  int_worklist_reserve(&w, capacity);
+  return w;
+}
+
+void int_worklist_free(int_worklist* w){
+  assert(w != NULL);
+  // All levels share the buffer of level 0
+  free(w->bits[0]);
+  *w = int_worklist_empty();
+}
+
+// Sets the upper levels from level 0
+void int_worklist_summarize(int_worklist* w){
+  for(int l = 1; l < w->levels; ++l){
+    memset(w->bits[l], 0, w->words[l] * sizeof(uint64_t));
+    for(int i = 0; i < w->words[l-1]; ++i){
+      if(w->bits[l-1][i] != 0){
+        w->bits[l][i >> 6] |= UINT64_C(1) << (i & 63);
+      }
+    }
+  }
+}
+
+void int_worklist_reserve(int_worklist* w, int capacity){
+  assert(w != NULL);
+  if(capacity <= w->capacity){
+    return;
+  }
+  int_worklist v = int_worklist_empty();
+  int total = 0;
+  int words = (capacity + 63) >> 6;
+  do{
+    assert(v.levels < INT_WORKLIST_LEVELS);
+    v.words[v.levels] = words;
+    total += words;
+    v.levels += 1;
+    words = (words + 63) >> 6;
+  }while(v.words[v.levels - 1] > 1);
+  v.bits[0] = calloc(total, sizeof(uint64_t));
+  for(int l = 1; l < v.levels; ++l){
+    v.bits[l] = v.bits[l-1] + v.words[l-1];
+  }
+  v.capacity = v.words[0] * 64;
+  v.size     = w->size;
+  if(w->levels > 0){
+    memcpy(v.bits[0], w->bits[0], w->words[0] * sizeof(uint64_t));
+    int_worklist_summarize(&v);
+  }
+  int_worklist_free(w);
+  *w = v;
+}
+
+void int_worklist_copy_into(int_worklist* w, int_worklist* v){
+  assert(w != NULL && v != NULL);
+  int_worklist_reserve(w, v->capacity);
+  int_worklist_clear(w);
+  if(v->levels > 0){
+    memcpy(w->bits[0], v->bits[0], v->words[0] * sizeof(uint64_t));
+    int_worklist_summarize(w);
+  }
+  w->size = v->size;
+}
+
+int_worklist int_worklist_copy(int_worklist* w){
+  assert(w != NULL);
+  int_worklist v = int_worklist_new(w->capacity);
+  int_worklist_copy_into(&v, w);
+  return v;
+}
+
+void int_worklist_clear(int_worklist* w){
+  assert(w != NULL);
+  if(w->size == 0){
+    return;
+  }
+  for(int l = 0; l < w->levels; ++l){
+    memset(w->bits[l], 0, w->words[l] * sizeof(uint64_t));
+  }
+  w->size = 0;
+}
+
+void int_worklist_insert_range(int_worklist* w, int a, int b){
+  assert(w != NULL);
+  for(int i = a; i <= b; ++i){
+    int_worklist_insert(w, i);
+  }
+}
+
+void int_worklist_insert_word(int_worklist* w, int word){
+  assert(w != NULL && w->bits[0][word] != 0);
+  for(int l = 1; l < w->levels; ++l){
+    uint64_t* bits = &w->bits[l][word >> 6];
+    bool was_empty = *bits == 0;
+    *bits |= UINT64_C(1) << (word & 63);
+    if(!was_empty){
+      break;
+    }
+    word >>= 6;
+  }
+}
+
+void int_worklist_map_monotonous(int_worklist* w, int(*f)(int)){
+  assert(w != NULL);
+  int_worklist v = int_worklist_new(w->capacity);
+  while(!int_worklist_is_empty(w)){
+    int_worklist_insert(&v, f(int_worklist_pop(w)));
+  }
+  int_worklist_free(w);
+  *w = v;
+}
+
+void int_worklist_print(int_worklist* w){
+  assert(w != NULL);
+  for(int i = 0; i < w->capacity; ++i){
+    if(int_worklist_contains(w, i)){
+      printf("%d ", i);
+    }
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef ALGO_GISO_WORKLIST_H
+#define ALGO_GISO_WORKLIST_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "assert.h"
+
+/*
+ * int_worklist
+ *
+ * Set of integers in [0, capacity) popped in increasing order, used as the queue of classes to refine.
+ * Hierarchical bitset : bits[0] has one bit per element, bits[l+1] one bit per non zero word of bits[l],
+ * the last level is a single word.
+ * Insert and pop touch one word per level (at most INT_WORKLIST_LEVELS), no allocation unless
+ * the capacity has to grow
+ */
+
+#define INT_WORKLIST_LEVELS 5
+
+typedef struct int_worklist {
+  int       size;
+  int       capacity;
+  int       levels;
+  uint64_t* bits[INT_WORKLIST_LEVELS];
+  int       words[INT_WORKLIST_LEVELS];
+} int_worklist;
+
+int_worklist int_worklist_empty();
+int_worklist int_worklist_new(int capacity);
+void int_worklist_free(int_worklist* w);
+// Keeps the elements
+void int_worklist_reserve(int_worklist* w, int capacity);
+// O(capacity / 64) copy, into the buffers of w when they are large enough
+void int_worklist_copy_into(int_worklist* w, int_worklist* v);
+int_worklist int_worklist_copy(int_worklist* w);
+void int_worklist_clear(int_worklist* w);
+void int_worklist_insert_range(int_worklist* w, int a, int b);
+void int_worklist_map_monotonous(int_worklist* w, int(*f)(int));
+void int_worklist_print(int_worklist* w);
+
+static inline bool int_worklist_is_empty(const int_worklist* w){
+  return w->size == 0;
+}
+
+static inline bool int_worklist_contains(const int_worklist* w, int v){
+  return v < w->capacity && ((w->bits[0][v >> 6] >> (v & 63)) & 1);
+}
+
+// Returns false if v was already in w
+static inline bool int_worklist_insert(int_worklist* w, int v){
+  assert(v >= 0);
+  if(v >= w->capacity){
+    int_worklist_reserve(w, 2 * v + 64);
+  }
+  if(int_worklist_contains(w, v)){
+    return false;
+  }
+  w->size += 1;
+  for(int l = 0; l < w->levels; ++l){
+    uint64_t* word = &w->bits[l][v >> 6];
+    bool was_empty = *word == 0;
+    *word |= UINT64_C(1) << (v & 63);
+    if(!was_empty){
+      break;
+    }
+    v >>= 6;
+  }
+  return true;
+}
+
+/*
+ * Insertion from several threads at once, on the first level only : returns 1 if v is added, 2 if its word
+ * was empty too, 0 if v was already in w. v < capacity.
+ * Once all the threads are done, size is increased by the number of elements added,
+ * and int_worklist_insert_word is called on the word of each element for which 2 was returned
+ */
+static inline int int_worklist_insert_shared(int_worklist* w, int v){
+  assert(v >= 0 && v < w->capacity);
+  uint64_t bit = UINT64_C(1) << (v & 63);
+  if(__atomic_load_n(&w->bits[0][v >> 6], __ATOMIC_RELAXED) & bit){
+    return 0;
+  }
+  uint64_t old = __atomic_fetch_or(&w->bits[0][v >> 6], bit, __ATOMIC_RELAXED);
+  return (old & bit) ? 0 : (old == 0 ? 2 : 1);
+}
+
+// Sets the bits of the levels above word of the first level
+void int_worklist_insert_word(int_worklist* w, int word);
+
+// Removes and returns the minimum
+static inline int int_worklist_pop(int_worklist* w){
+  assert(w->size > 0);
+  int v = 0;
+  for(int l = w->levels - 1; l >= 0; --l){
+    v = (v << 6) | __builtin_ctzll(w->bits[l][v]);
+  }
+  w->size -= 1;
+  int u = v;
+  for(int l = 0; l < w->levels; ++l){
+    uint64_t* word = &w->bits[l][u >> 6];
+    *word &= ~(UINT64_C(1) << (u & 63));
+    if(*word != 0){
+      break;
+    }
+    u >>= 6;
+  }
+  return v;
+}
+
+#endif